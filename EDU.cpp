@@ -40,6 +40,19 @@
 //           /help
 //           /h                Displays the usage message.
 //  
+//           /allocated
+//           /a                Count the space each file occupies on disk (GetCompressedFileSize)
+//                             rather than its apparent length, so compressed and sparse files
+//                             show what they really cost.
+//  
+//           /both
+//           /b                Count both sizes in the one pass and print two columns.
+//  
+//           /units=B|K|M|G|T|auto
+//           /u=...            Print sizes in exact bytes, or in kilo-, mega- (the default), giga- or
+//                             terabytes; auto picks the largest unit each size is at least one of.
+//                             Sizes are always counted in bytes; this only changes the printing.
+//  
 //           /level=1..999     Level which to display directories:
 //                             ;   .     = 1
 //                             ;   ./a   = 2
@@ -70,24 +83,26 @@
 //   23.74 Megabytes in .\19.27
 //   23.74 Megabytes in .
 //    
-//  Building EDU using Cygwin on Windows:
-//        gcc -edu.c
+//  The scanning itself is done by libedu.hpp, a header only library with a visitor interface that
+//  other programs can build in as well; this file is the command line around it.  edu.c does not use
+//  libedu.hpp, so bench/samecount.sh checks that the two print the same byte totals for a tree.
+//
+//  Building EDU using Cygwin on Windows, or on UNIX, with libedu.hpp alongside:
+//        g++ -O2 -o edu EDU.cpp
 //  
 //----------------------------------------------------------------------------------------------------
 //  Revision | Date       | Comments
 //----------------------------------------------------------------------------------------------------
 //  1.0      | 1993       | Original
 //  1.4      | 10-09-2022 | Cleaned up and compiled with Cygwin.
+//  1.5      |            | The engine moved out into libedu.hpp.
 //----------------------------------------------------------------------------------------------------
 //
 #include<stdio.h>
 #include<stdlib.h>
 #include<ctype.h>
 #include<string.h>
-#include<sys/types.h>
-#include<sys/stat.h>
-#include<windows.h>
-#include<io.h>
+#include"libedu.hpp"
 
 //
 // TRUE/FALSE
@@ -104,120 +119,160 @@
 
 ///----------------------------------------------------------------------------------------------------
 ///<summary>
-///   Total - This is a structure representing a directory total in megabytes and bytes.
+///   Total - A directory total as exact 64 bit byte and file counts, from libedu.  Nothing is turned
+///           into megabytes until it is printed.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+typedef edu::Total Total;
+
+//
+// Which sizes to count: apparent, allocated on disk, or both.
+//
+#define SIZE_APPARENT  1
+#define SIZE_ALLOCATED 2
+#define SIZE_BOTH      3
+
+//
+// Which unit to print sizes in.  UNIT_AUTO picks the largest unit the size is at least one of.
+//
+#define UNIT_B         0
+#define UNIT_K         1
+#define UNIT_M         2
+#define UNIT_G         3
+#define UNIT_T         4
+#define UNIT_AUTO     -1
+
+static const char  *g_rgszUnitNames[] = { "Bytes", "Kilobytes", "Megabytes", "Gigabytes", "Terabytes" };
+static const double g_rgdUnitSizes[]  = { 1.0, 1024.0, (double) MEGABYTE, 1073741824.0, 1099511627776.0 };
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   UnitOf - The unit to print qwBytes in.
 ///</summary>
 ///----------------------------------------------------------------------------------------------------
-typedef struct _Total
+int UnitOf( uint64_t qwBytes, int iUnits )
 {
-    DWORD64 qwMegabytes;
-    DWORD64 qwBytes;
+    int iUnit = UNIT_B;
+
+    if( iUnits != UNIT_AUTO )
+    {
+        return iUnits;
+    }
+
+    while( iUnit < UNIT_T && (double) qwBytes >= g_rgdUnitSizes[ iUnit + 1 ] )
+    {
+        iUnit++;
+    }
+
+    return iUnit;
     
-} Total;
+}//UnitOf
 
 ///----------------------------------------------------------------------------------------------------
 ///<summary>
-///   Add - Add Megabytes and bytes to an existing structure.
+///   PrintSize - Print one size in a unit: exact digits for bytes, else two decimals.
 ///</summary>
 ///----------------------------------------------------------------------------------------------------
-void Add( DWORD64 qwMegs, DWORD64 qwBytes, Total *sNumber )
+void PrintSize( uint64_t qwBytes, int iUnit )
 {
-    //
-    // Add the megabytes and bytes.
-    //
-    sNumber->qwMegabytes += qwMegs;
-    sNumber->qwBytes     += qwBytes;
-
-    //
-    // Convert the bytes into megabytes.
-    //
-    while( sNumber->qwBytes > MEGABYTE )
+    if( iUnit == UNIT_B )
     {
-        sNumber->qwMegabytes = sNumber->qwMegabytes + 1       ;
-        sNumber->qwBytes     = sNumber->qwBytes     - MEGABYTE;
+        printf( "%12llu", (unsigned long long) qwBytes );
+    }
+    else
+    {
+        printf( "%12.2lf", (double) qwBytes / g_rgdUnitSizes[ iUnit ] );
     }
     
-}//Add
+}//PrintSize
 
 ///----------------------------------------------------------------------------------------------------
 ///<summary>
-///   DirectoryTotal - Totalling engine, recursively called.
+///   PrintTotal - Print one line of output in the chosen size mode.  With no directory name it is
+///                the grand total line.  With both sizes, the allocated one is in the same unit.
 ///</summary>
 ///----------------------------------------------------------------------------------------------------
-Total DirectoryTotal( char *szDirectoryName, int bTotalOnly, int RecursionLevel, int RecursionLimit )
-{ 
-    HANDLE           hFind                                         =  0   ;
-    WIN32_FIND_DATA  sFileInfo                                     = {0}  ;
-    DWORD64          qwFileSize                                    =  0   ;
-    BOOL             ucStatus                                      = TRUE ;
-    Total            sDirTotal                                     = {0,0};
-    Total            sTempTotal                                    = {0,0};
-    char             szEffectivePath [MAX_PATH + FILENAME_MAX + 1] = {0}  ;
-    char             szFileSpec      [MAX_PATH + FILENAME_MAX + 1] = {0}  ;
-    char             szNewDir        [MAX_PATH + FILENAME_MAX + 1] = {0}  ;
+void PrintTotal( const Total *psTotal, int iSizes, int iUnits, const char *szDirectoryName )
+{
+    uint64_t qwShown = ( iSizes == SIZE_ALLOCATED ) ? psTotal->allocated : psTotal->bytes;
+    int      iUnit   = UnitOf( qwShown, iUnits );
 
-    //
-    // Since this is recursive, we start with current path, plus the new directory name.
-    //
-    sprintf( szEffectivePath, "%s\\*.*", szDirectoryName );
+    PrintSize( qwShown, iUnit );
+    printf( " %s", g_rgszUnitNames[ iUnit ] );
 
-    //
-    // Find the first file in the directory.
-    //
-    hFind = FindFirstFile( szEffectivePath, &sFileInfo );
-    
-    if( hFind == INVALID_HANDLE_VALUE )
+    if( iSizes == SIZE_BOTH )
     {
-        return sDirTotal;
+        printf( " " );
+        PrintSize( psTotal->allocated, iUnit );
+        printf( " allocated" );
     }
-    else
+
+    if( szDirectoryName != NULL )
     {
-        ucStatus = TRUE;
+        printf( " in %-s", szDirectoryName );
     }
 
-    //
-    //
-    //
-    while( ucStatus )
-    {
-        if( ( sFileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) == FILE_ATTRIBUTE_DIRECTORY )
-        {
-            if( ( 0 != strcmp( sFileInfo.cFileName , "." )  ) && ( 0 != strcmp( sFileInfo.cFileName, "..") ) )
-            {
-                sprintf( szNewDir,"%s\\%s", szDirectoryName, sFileInfo.cFileName );
-                
-                sTempTotal = DirectoryTotal( szNewDir, bTotalOnly, RecursionLevel + 1, RecursionLimit );
-                
-                Add( sTempTotal.qwMegabytes, (unsigned long) sTempTotal.qwBytes, &sDirTotal );
-            }
-        }
-        else 
-        {
-            qwFileSize = ( sFileInfo.nFileSizeHigh * (MAXDWORD) ) + sFileInfo.nFileSizeLow;
-            
-            Add( 0, qwFileSize, &sDirTotal );
-        }
-        
-        ucStatus = FindNextFile( hFind, &sFileInfo );
-        
-        sprintf( szFileSpec, "%-s\\%-s", szDirectoryName, sFileInfo.cFileName );
-        
-    }//while
+    printf( "\n" );
     
-    if( bTotalOnly == FALSE )
+}//PrintTotal
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Printer - The visitor the scan reports to.  Each directory is printed as it is left, so after
+///             its subdirectories, down to the display level.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct Printer : edu::Visitor
+{
+    int iSizes;
+    int iUnits;
+    int iRecursionLimit;
+
+    void on_leave_dir( const char *szPath, int iLevel, const Total &sTotal )
     {
-        if( RecursionLevel  <= RecursionLimit )
+        if( iLevel <= iRecursionLimit )
         {
-            printf( "%12.2lf Megabytes in %-s\n", 
-                    (double)( (double) sDirTotal.qwMegabytes + ( (double) sDirTotal.qwBytes/ (double) MEGABYTE ) ), szDirectoryName);
+            PrintTotal( &sTotal, iSizes, iUnits, szPath );
         }
     }
-    
-    FindClose( hFind );
-    
-    return ( sDirTotal );
-    
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   DirectoryTotal - Pick the scan for the size mode; Output says whether directories are printed.
+///                    Each combination is its own compiled loop, so /t has no printing in it and
+///                    only /a and /b look up the on-disk size.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+template< class Output >
+Total DirectoryTotal( const char *szDirectoryName, Printer &sPrinter )
+{
+    if( sPrinter.iSizes & SIZE_ALLOCATED )
+    {
+        return edu::Walk< Output, edu::AllocatedSize, edu::CountLinks >( szDirectoryName, sPrinter );
+    }
+
+    return edu::Walk< Output, edu::ApparentSize, edu::CountLinks >( szDirectoryName, sPrinter );
+
 }//DirectoryTotal
 
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   isWord - Compare an option value with a word, ignoring case.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+int isWord( const char *szValue, const char *szWord )
+{
+    while( *szWord != 0 && toupper( *szValue ) == toupper( *szWord ) )
+    {
+        szValue++;
+        szWord++;
+    }
+
+    return *szValue == 0 && *szWord == 0;
+
+}//isWord
+
 ///----------------------------------------------------------------------------------------------------
 ///<summary>
 ///   isOptionChar - Allow a / and - for option characters.
@@ -246,7 +301,7 @@ int main( int argc, char *argv[] )
     //
     // Where are we starting?  Default to current directory.
     //
-    char          szPath              [MAX_PATH + FILENAME_MAX + 1] = "."  ;
+    const char   *szPath                                            = "."  ;
 
     //
     // By default we show all directories, not just "totals".
@@ -256,13 +311,23 @@ int main( int argc, char *argv[] )
     //
     // This is the overall total.
     //
-    Total         sOverallTotal                                     = {0}  ;
+    Total         sOverallTotal                                     = {0,0,0};
 
     //
     // Allow going this many levels of directory structures.
     //
     int           iRecursionLimit                                   = 999  ;
 
+    //
+    // Apparent size unless /allocated or /both says otherwise.
+    //
+    int           iSizes                                            = SIZE_APPARENT;
+
+    //
+    // Megabytes unless /units says otherwise.
+    //
+    int           iUnits                                            = UNIT_M;
+
     //
     // Parse command line arguments.
     //
@@ -279,6 +344,9 @@ int main( int argc, char *argv[] )
             printf( "edu [/total_only]         Displays the overall total only.          \n" );
             printf( "    [/help]               Displays this help message.               \n" );
             printf( "    [/?]                  Displays this help message.               \n" );
+            printf( "    [/allocated]          Counts space allocated on disk.           \n" );
+            printf( "    [/both]               Counts apparent and allocated sizes.      \n" );
+            printf( "    [/units=B|K|M|G|T|auto] Unit to print sizes in (default: M).    \n" );
             printf( "    [/level=1..999]       Level to display directories:             \n" );
             printf( "                            .     = 1                               \n" );
             printf( "                            ./a   = 2                               \n" );
@@ -296,6 +364,42 @@ int main( int argc, char *argv[] )
             ucTotalOnly = TRUE;
         }
         //
+        // On-disk size mode /a.
+        //
+        else if( isOptionChar( argv[ argc ][ 0 ] ) && toupper( argv[ argc ][ 1 ] ) == 'A' )
+        {
+            iSizes = SIZE_ALLOCATED;
+        }
+        //
+        // Both sizes mode /b.
+        //
+        else if( isOptionChar( argv[ argc ][ 0 ] ) && toupper( argv[ argc ][ 1 ] ) == 'B' )
+        {
+            iSizes = SIZE_BOTH;
+        }
+        //
+        // Units /u=B|K|M|G|T|auto.
+        //
+        else if( isOptionChar( argv[ argc ][ 0 ] ) && toupper( argv[ argc ][ 1 ] ) == 'U' )
+        {
+            char       *p       = strchr( argv[ argc ], '=' );
+            const char *szUnits = "BKMGT";
+
+            if( p != NULL && isWord( p + 1, "auto" ) )
+            {
+                iUnits = UNIT_AUTO;
+            }
+            else if( p != NULL && p[ 1 ] != 0 && p[ 2 ] == 0 && strchr( szUnits, toupper( p[ 1 ] ) ) != NULL )
+            {
+                iUnits = (int)( strchr( szUnits, toupper( p[ 1 ] ) ) - szUnits );
+            }
+            else
+            {
+                fprintf(stderr,"edu: /units needs =B, =K, =M, =G, =T or =auto.\n" );
+                exit(1);
+            }
+        }
+        //
         // Setting recursion limit.
         //
         else if( isOptionChar( argv[ argc ][ 0 ] ) && toupper( argv[ argc ][ 1 ] ) == 'L' )
@@ -319,7 +423,7 @@ int main( int argc, char *argv[] )
         }
         else
         {
-            strcpy( szPath, argv[ argc ] );
+            szPath = argv[ argc ];
         }
         
     }//while( --argc )
@@ -327,15 +431,27 @@ int main( int argc, char *argv[] )
     //
     // Call the totaling engine.
     //
-    sOverallTotal =   DirectoryTotal( szPath, ucTotalOnly, 1, iRecursionLimit ) ;
+    Printer sPrinter;
+
+    sPrinter.iSizes          = iSizes;
+    sPrinter.iUnits          = iUnits;
+    sPrinter.iRecursionLimit = iRecursionLimit;
+
+    if( ucTotalOnly )
+    {
+        sOverallTotal = DirectoryTotal< edu::TotalOnly >( szPath, sPrinter );
+    }
+    else
+    {
+        sOverallTotal = DirectoryTotal< edu::EveryDirectory >( szPath, sPrinter );
+    }
 
     //
     // If totals only.
     //
     if( ucTotalOnly )
     {
-        printf( "%12.2lf Megabytes\n",
-                (double)((double) sOverallTotal.qwMegabytes+((double)sOverallTotal.qwBytes/(double)MEGABYTE)));
+        PrintTotal( &sOverallTotal, iSizes, iUnits, NULL );
     }
     
     return 0;
@@ -0,0 +1,180 @@
+#!/bin/sh
+#
+#  bench.sh - Benchmark the EDU engines on synthetic trees.
+#
+#  Builds edu, edutree and edubench, makes the trees below (once; the same
+#  options always make the same tree), checks with samecount.sh that edu.c
+#  and EDU.cpp count them alike, times each engine on each tree and
+#  compares the numbers with baselines.txt.  A line is marked SLOWER when
+#  its entries/sec fall more than 10% below the baseline, and MORE CALLS
+#  when its syscalls/entry rise more than 5% above it.
+#
+#  Usage:
+#         bench.sh            Run and compare.
+#         bench.sh update     Run and write the results to baselines.txt.
+#
+#  BENCH_DIR (default /tmp/edu-bench) holds the binaries and trees, and
+#  RUNS (default 5) is passed to edubench.  Baselines are only comparable
+#  on the machine and filesystem they were taken on, so none are kept in
+#  the tree: run once with `update' on the host to be compared, with at
+#  least 4 CPUs so the /threads=4 lines mean something.  Without a
+#  baselines file the results are printed as they are.  BASELINES
+#  (default baselines.txt here) picks the file, so one kept per kind of
+#  disk can be compared with a BENCH_DIR on that disk: /inode-order pays
+#  off on rotational disks and hardly at all on SSDs, e.g.
+#
+#         BENCH_DIR=/hdd/edu-bench BASELINES=baselines-hdd.txt bench.sh
+#
+#  The disk named in a baselines header comes from lsblk unless DISK
+#  says what it is, e.g. DISK="7200 rpm SATA disk" bench.sh update; only
+#  trust the advice above when it does.
+#
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BENCH_DIR=${BENCH_DIR:-/tmp/edu-bench}
+RUNS=${RUNS:-5}
+BASELINES=${BASELINES:-$HERE/baselines.txt}
+CC=${CC:-cc}
+
+mkdir -p "$BENCH_DIR"
+
+if [ "$(nproc)" -lt 4 ]
+then
+   echo "bench.sh: only $(nproc) CPUs; the .threads lines cannot show /threads=4 running in parallel." >&2
+fi
+
+$CC -O2 -pthread -o "$BENCH_DIR/edu"      "$HERE/../edu.c"
+$CC -O2          -o "$BENCH_DIR/edutree"  "$HERE/edutree.c" -lm
+$CC -O2          -o "$BENCH_DIR/edubench" "$HERE/edubench.c"
+
+#
+#  The trees: many directories of mixed size, one long chain, and a tree
+#  with hard and symbolic links among the files.
+#
+
+tree()
+{
+   name=$1
+   shift
+   if [ ! -d "$BENCH_DIR/$name" ] || [ "$(cat "$BENCH_DIR/$name.shape" 2>/dev/null)" != "$*" ]
+   then
+      rm -rf "$BENCH_DIR/$name"
+      "$BENCH_DIR/edutree" "$@" "$BENCH_DIR/$name" > /dev/null
+      echo "$*" > "$BENCH_DIR/$name.shape"
+   fi
+}
+
+tree wide  /fanout=16 /depth=3    /files=0..64 /skew=2 /seed=1
+tree deep  /fanout=1  /depth=2000 /files=0..4  /skew=1 /seed=2
+tree mixed /fanout=6  /depth=5    /files=0..48 /skew=3 /links=5 /symlinks=5 /seed=3
+
+#
+#  Timings of an engine that miscounts mean nothing, so first check that
+#  edu.c and EDU.cpp agree on every tree.
+#
+
+(cd "$BENCH_DIR" && "$HERE/samecount.sh" wide deep mixed)
+
+#
+#  One line per tree and engine.  Cold runs drop the caches first.
+#
+
+run()
+{
+   label=$1
+   shift
+   (cd "$BENCH_DIR" && ./edubench /runs="$RUNS" /label="$label" "$@")
+}
+
+results=$BENCH_DIR/results.txt
+{
+   for t in wide deep mixed
+   do
+      rm -f "$BENCH_DIR/$t.idx" "$BENCH_DIR/$t".shard?
+      line=$(run "$t.serial" ./edu "$t")
+      echo "$line"
+      entries=$(echo "$line" | awk '{ print $2 }')
+      run "$t.threads"       ./edu /threads=4 "$t"
+      run "$t.cache"         /entries="$entries" ./edu /cache="$t.idx" "$t"
+      run "$t.dedupe"        ./edu /dedupe-links "$t"
+      run "$t.inode"         ./edu /inode-order "$t"
+      run "$t.uring"         ./edu /uring "$t"
+      run "$t.histogram"     ./edu /histogram "$t"
+      run "$t.owner"         ./edu /by-owner "$t"
+      run "$t.sort"          ./edu /sort=size "$t"
+      run "$t.bin"           ./edu /format=bin "$t"
+      run "$t.duplicates"    ./edu /duplicates "$t"
+      run "$t.shard"         ./edu /shard=1/4 "$t"
+      for k in 1 2 3 4
+      do
+         (cd "$BENCH_DIR" && ./edu /shard=$k/4 "$t" > "$t.shard$k")
+      done
+      run "$t.merge"         /entries="$entries" ./edu /merge "$t.shard1" "$t.shard2" "$t.shard3" "$t.shard4"
+   done
+   for t in wide mixed
+   do
+      run "$t.serial.cold"   /cold="$t" ./edu "$t"
+      run "$t.threads.cold"  /cold="$t" ./edu /threads=4 "$t"
+      run "$t.inode.cold"    /cold="$t" ./edu /inode-order "$t"
+   done
+} > "$results"
+
+#
+#  What kind of disk the trees are on, for the baselines header.  DISK,
+#  if set, is taken as it is.  Otherwise it is what lsblk says, and is
+#  marked as such: virtual and network devices often claim to be
+#  rotational whatever is under them.
+#
+
+disk()
+{
+   if [ -n "$DISK" ]
+   then
+      echo "$DISK"
+      return
+   fi
+   dev=$(df --output=source "$BENCH_DIR" 2>/dev/null | tail -1)
+   case "$(lsblk -ndo ROTA "$dev" 2>/dev/null | head -1 | tr -d ' ')" in
+      1) echo "rotational disk (lsblk ROTA, unverified; set DISK)" ;;
+      0) echo "solid state disk (lsblk ROTA, unverified; set DISK)" ;;
+      *) echo "unknown disk (set DISK)" ;;
+   esac
+}
+
+if [ "$1" = "update" ]
+then
+   {
+      echo "# edu benchmark baselines, written by bench.sh update."
+      echo "# $(uname -srm), $(nproc) CPUs, $(stat -f -c %T "$BENCH_DIR") filesystem, $(disk)."
+      echo "# label                     entries   seconds  entries/sec syscalls/entry peak_rss_kb"
+      cat "$results"
+   } > "$BASELINES"
+   cat "$results"
+   exit 0
+fi
+
+#
+#  Compare with the baselines by label.
+#
+
+if [ ! -f "$BASELINES" ]
+then
+   echo "bench.sh: no $BASELINES to compare with; run \`bench.sh update' to write one." >&2
+   cat "$results"
+   exit 0
+fi
+
+awk '
+   NR == FNR { if( $1 !~ /^#/ ) { rate[$1] = $4; calls[$1] = $5 } next }
+   {
+      note = ""
+      if( $1 in rate && $4 < rate[$1] * 0.90 )
+         note = note " SLOWER"
+      if( $1 in calls && $5 > calls[$1] * 1.05 )
+         note = note " MORE CALLS"
+      base = ( $1 in rate ) ? sprintf( "%12.0f", rate[$1] ) : "           -"
+      printf( "%s  base %s%s\n", $0, base, note )
+   }
+' "$BASELINES" "$results"
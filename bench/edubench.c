@@ -0,0 +1,390 @@
+/*
+
+  edubench.c - Time one EDU command and report what it cost.
+
+  The command is run a number of times and its median wall time, the
+  entries it read (from /stats), its peak resident size and the system
+  calls it made per entry are printed on one line:
+
+    LABEL  ENTRIES  SECONDS  ENTRIES/SEC  SYSCALLS/ENTRY  PEAK_RSS_KB
+
+  System calls are counted in one extra run under ptrace, every thread
+  included, so the counting does not slow the timed runs.
+
+  Usage:
+         edubench [options] edu [edu options] dirname
+
+         /runs=N           Timed runs (default 5).  Without /cold one more
+                           untimed run comes first to warm the caches.
+
+         /cold=DIR         Before each timed run, drop the caches for DIR.
+                           As root the kernel's page, dentry and inode
+                           caches are dropped.  Otherwise only the pages
+                           of the files and directories under DIR are
+                           dropped with posix_fadvise, which is noted on
+                           stderr, and the dentry and inode caches stay
+                           warm.
+
+         /label=TEXT       What to call the command on its line (default:
+                           the command's last argument).
+
+         /entries=N        Divide by N entries rather than the count from
+                           /stats, for commands that skip reading some of
+                           the tree, such as edu /cache.
+
+  /stats is added to the command, and its standard output is thrown away.
+
+*/
+
+#define _GNU_SOURCE
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<ctype.h>
+#include<string.h>
+#include<errno.h>
+#include<signal.h>
+#include<time.h>
+#include<ftw.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<sys/wait.h>
+#include<sys/resource.h>
+#include<sys/ptrace.h>
+#include<fcntl.h>
+#include<unistd.h>
+
+#ifndef TRUE
+#define TRUE                  1
+#define FALSE                 0
+#endif
+
+#define MAX_RUNS              101
+
+typedef struct run{
+                         double              seconds;
+                         unsigned long long  entries;
+                         unsigned long long  syscalls;
+                         long                maxrss;     /* kilobytes */
+
+                    } Run;
+
+/*
+        Start the command with its standard output thrown away and its
+        standard error going to `errfd'.  With `trace' it stops at exec
+        for the tracer.
+*/
+
+pid_t Start( char **command, int errfd, int trace )
+{
+   pid_t pid;
+   int null;
+
+   if( -1 == ( pid = fork() ) )
+   {
+      perror( "edubench: fork" );
+      exit(1);
+   }
+
+   if( pid == 0 )
+   {
+      null = open( "/dev/null", O_WRONLY );
+      dup2( null, 1 );
+      dup2( errfd, 2 );
+      if( trace && ptrace( PTRACE_TRACEME, 0, NULL, NULL ) == -1 )
+         _exit(126);
+      execvp( command[0], command );
+      _exit(127);
+   }
+
+   return( pid );
+}
+
+/*
+        Follow a traced command and every thread it starts to the end,
+        counting the system calls they make.  Each call stops its thread
+        twice, on the way in and on the way out.
+*/
+
+unsigned long long Trace( pid_t pid, int *status )
+{
+   unsigned long long stops = 0;
+   pid_t tid;
+   int st, sig;
+
+   if( waitpid( pid, &st, 0 ) == -1 || !WIFSTOPPED( st ) )
+   {
+      fprintf(stderr,"edubench: The command could not be traced.\n" );
+      exit(1);
+   }
+
+   ptrace( PTRACE_SETOPTIONS, pid, NULL,
+           (void *)(long)( PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL ) );
+   ptrace( PTRACE_SYSCALL, pid, NULL, NULL );
+
+   for(;;)
+   {
+      if( -1 == ( tid = waitpid( -1, &st, __WALL ) ) )
+      {
+         if( errno == EINTR )
+            continue;
+         break;
+      }
+
+      if( WIFEXITED( st ) || WIFSIGNALED( st ) )
+      {
+         if( tid == pid )
+         {
+            *status = st;
+            break;
+         }
+         continue;
+      }
+
+      sig = 0;
+      if( WSTOPSIG( st ) == ( SIGTRAP | 0x80 ) )
+         stops++;
+      else if( WSTOPSIG( st ) != SIGTRAP && WSTOPSIG( st ) != SIGSTOP )
+         sig = WSTOPSIG( st );
+
+      ptrace( PTRACE_SYSCALL, tid, NULL, (void *)(long) sig );
+   }
+
+   return( ( stops + 1 ) / 2 );
+}
+
+/*
+        Pull the entry count out of the /stats line on standard error, the
+        one that reads "edu: N entries, ...".  Warnings may come before it.
+        Without it the rates would be nonsense, so that is an error.
+*/
+
+unsigned long long Entries( int errfd )
+{
+   char buf[4096], *line, *next;
+   unsigned long long n;
+   FILE *f;
+
+   lseek( errfd, 0, SEEK_SET );
+   if( NULL == ( f = fdopen( dup( errfd ), "r" ) ) )
+   {
+      perror( "edubench: fdopen" );
+      exit(1);
+   }
+
+   while( NULL != ( line = fgets( buf, sizeof(buf), f ) ) )
+   {
+      if( 0 != strncmp( line, "edu: ", 5 ) )
+         continue;
+      n = strtoull( line + 5, &next, 10 );
+      if( next != line + 5 && 0 == strncmp( next, " entries, ", 10 ) )
+      {
+         fclose( f );
+         return( n );
+      }
+   }
+
+   fclose( f );
+   fprintf(stderr,"edubench: The command printed no entry count on stderr.\n" );
+   exit(1);
+}
+
+/*
+        Run the command once, timed, or traced to count its calls.
+*/
+
+void RunOnce( char **command, int trace, Run *run )
+{
+   struct timespec start, end;
+   struct rusage usage;
+   char errname[] = "/tmp/edubenchXXXXXX";
+   int errfd, status = 0;
+   pid_t pid;
+
+   if( -1 == ( errfd = mkstemp( errname ) ) )
+   {
+      perror( "edubench: mkstemp" );
+      exit(1);
+   }
+   unlink( errname );
+
+   memset( run, 0, sizeof(Run) );
+   clock_gettime( CLOCK_MONOTONIC, &start );
+
+   pid = Start( command, errfd, trace );
+
+   if( trace )
+      run->syscalls = Trace( pid, &status );
+   else if( wait4( pid, &status, 0, &usage ) == -1 )
+   {
+      perror( "edubench: wait4" );
+      exit(1);
+   }
+   else
+      run->maxrss = usage.ru_maxrss;
+
+   clock_gettime( CLOCK_MONOTONIC, &end );
+
+   if( !WIFEXITED( status ) || WEXITSTATUS( status ) != 0 )
+   {
+      fprintf(stderr,"edubench: %s failed.\n", command[0] );
+      exit(1);
+   }
+
+   run->seconds = (double)( end.tv_sec - start.tv_sec ) + (double)( end.tv_nsec - start.tv_nsec ) / 1e9;
+   run->entries = Entries( errfd );
+   close( errfd );
+}
+
+/*
+        Cold cache.  Dropping the kernel's caches needs root; without it the
+        pages of everything under the tree are dropped one file at a time.
+*/
+
+int Evict( const char *name, const struct stat *statbuf, int type, struct FTW *ftw )
+{
+   int fd;
+
+   (void) statbuf;
+   (void) ftw;
+
+   if( type != FTW_F && type != FTW_D && type != FTW_DP )
+      return( 0 );
+
+   if( -1 != ( fd = open( name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK ) ) )
+   {
+      posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+      close( fd );
+   }
+   return( 0 );
+}
+
+void DropCaches( char *dir )
+{
+   static int warned = FALSE;
+   int fd;
+
+   sync();
+
+   if( -1 != ( fd = open( "/proc/sys/vm/drop_caches", O_WRONLY ) ) )
+   {
+      if( write( fd, "3", 1 ) == 1 )
+      {
+         close( fd );
+         return;
+      }
+      close( fd );
+   }
+
+   if( !warned )
+   {
+      fprintf(stderr,"edubench: Cannot drop the kernel caches, dropping file pages only.\n" );
+      warned = TRUE;
+   }
+   nftw( dir, Evict, 64, FTW_PHYS | FTW_DEPTH );
+}
+
+int CompareSeconds( const void *a, const void *b )
+{
+   const Run *x = a, *y = b;
+
+   return( ( x->seconds > y->seconds ) - ( x->seconds < y->seconds ) );
+}
+
+int isOptionChar( char c )
+{
+   return( c == '/' || c == '-' );
+}
+
+int isOption( char *arg, char *name )
+{
+   if( !isOptionChar( arg[0] ) )
+      return( FALSE );
+
+   for( arg++; *name != 0 && toupper( *arg ) == toupper( *name ); arg++, name++ )
+      ;
+
+   return( *name == 0 && ( *arg == 0 || *arg == '=' ) );
+}
+
+int main( int argc, char *argv[] )
+{
+   Run runs[ MAX_RUNS ], traced;
+   char **command, *cold = NULL, *label = NULL, *p;
+   unsigned long long entries = 0;
+   int nruns = 5, i, n;
+   long maxrss = 0;
+   double seconds;
+
+          /* Options up to the first argument that is not one: the command. */
+
+   for( i = 1; i < argc; i++ )
+   {
+      p = strchr( argv[i], '=' );
+
+      if( isOption( argv[i], "runs" ) && p != NULL )
+         nruns = atoi( p + 1 );
+      else if( isOption( argv[i], "cold" ) && p != NULL )
+         cold = p + 1;
+      else if( isOption( argv[i], "label" ) && p != NULL )
+         label = p + 1;
+      else if( isOption( argv[i], "entries" ) && p != NULL )
+         entries = strtoull( p + 1, NULL, 10 );
+      else
+         break;
+   }
+
+   if( i == argc )
+   {
+      fprintf(stderr,"edubench: No command given.\n" );
+      exit(1);
+   }
+   if( nruns < 1 || nruns > MAX_RUNS )
+   {
+      fprintf(stderr,"edubench: Invalid run count of %d.\n", nruns );
+      exit(1);
+   }
+
+          /* The command, with /stats added at the front of its options. */
+
+   n = argc - i;
+   if( NULL == ( command = calloc( (size_t) n + 2, sizeof(char *) ) ) )
+   {
+      fprintf(stderr,"edubench: Out of memory.\n" );
+      exit(1);
+   }
+   command[0] = argv[i];
+   command[1] = "/stats";
+   memcpy( command + 2, argv + i + 1, (size_t)( n - 1 ) * sizeof(char *) );
+
+   if( label == NULL )
+      label = argv[ argc - 1 ];
+
+   if( cold == NULL )
+      RunOnce( command, FALSE, &runs[0] );
+
+   for( i = 0; i < nruns; i++ )
+   {
+      if( cold != NULL )
+         DropCaches( cold );
+      RunOnce( command, FALSE, &runs[i] );
+      if( runs[i].maxrss > maxrss )
+         maxrss = runs[i].maxrss;
+   }
+
+   RunOnce( command, TRUE, &traced );
+
+   qsort( runs, (size_t) nruns, sizeof(Run), CompareSeconds );
+   seconds = ( nruns % 2 ) ? runs[ nruns / 2 ].seconds
+                           : ( runs[ nruns / 2 - 1 ].seconds + runs[ nruns / 2 ].seconds ) / 2.0;
+
+   if( entries == 0 )
+      entries = runs[0].entries;
+
+   printf( "%-24s %10llu %9.4f %12.0f %8.2f %8ld\n",
+           label, entries, seconds,
+           seconds > 0.0 ? (double) entries / seconds : 0.0,
+           entries ? (double) traced.syscalls / (double) entries : 0.0,
+           maxrss );
+   return 0;
+}
@@ -0,0 +1,410 @@
+/*
+
+  edutree.c - Build a synthetic directory tree for benchmarking EDU.
+
+  The same options and seed always build the same tree: every name, size,
+  file count and link comes from one seeded generator, and the tree is
+  built depth first in the same order every time.  Comparing two builds
+  of EDU on trees from different runs of edutree is therefore fair.
+
+  Usage:
+         edutree [options] dirname
+
+         /fanout=N         Subdirectories in each directory (default 4).
+
+         /depth=N          Levels of directories below dirname (default 4).
+                           /fanout=1 /depth=2000 gives one long chain.
+
+         /files=MIN..MAX   Files in each directory (default 0..32).
+
+         /skew=K           How file counts are spread between MIN and MAX:
+                           1 is even, larger K puts most directories near
+                           MIN and a few near MAX (default 2).
+
+         /size=MIN..MAX    File sizes in bytes, spread evenly on a log
+                           scale (default 0..1048576).
+
+         /names=MIN..MAX   Name lengths (default 4..16).
+
+         /links=P          P percent of files are hard links to an earlier
+                           file in the same directory (default 0).
+
+         /symlinks=P       P percent of entries are symbolic links to an
+                           earlier entry in the same directory (default 0).
+
+         /data             Write the file contents, so they take space on
+                           disk.  Otherwise files are sparse and only have
+                           a length, which is much faster to build.
+
+         /seed=N           Generator seed (default 1).
+
+  dirname must not exist yet.  A summary of what was built is printed
+  when done.
+
+*/
+
+#define _GNU_SOURCE
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<ctype.h>
+#include<string.h>
+#include<math.h>
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+
+#ifndef TRUE
+#define TRUE                  1
+#define FALSE                 0
+#endif
+
+#define MAX_NAME              255
+
+typedef struct shape{
+                         int                 fanout;
+                         int                 depth;
+                         long                minfiles, maxfiles;
+                         double              skew;
+                         unsigned long long  minsize, maxsize;
+                         int                 minname, maxname;
+                         int                 links;      /* percent */
+                         int                 symlinks;   /* percent */
+                         int                 data;
+
+                    } Shape;
+
+typedef struct built{
+                         unsigned long long  dirs;
+                         unsigned long long  files;
+                         unsigned long long  links;
+                         unsigned long long  symlinks;
+                         unsigned long long  bytes;
+
+                    } Built;
+
+static unsigned long long Seed = 1;
+
+/*
+        xorshift64*: small, fast, and the same everywhere.
+*/
+
+unsigned long long Random( void )
+{
+   Seed ^= Seed >> 12;
+   Seed ^= Seed << 25;
+   Seed ^= Seed >> 27;
+   return( Seed * 0x2545F4914F6CDD1DULL );
+}
+
+/*
+        A uniform number in [0, 1).
+*/
+
+double Uniform( void )
+{
+   return( (double)( Random() >> 11 ) / 9007199254740992.0 );
+}
+
+long Between( long min, long max )
+{
+   return( min + (long)( Random() % (unsigned long long)( max - min + 1 ) ) );
+}
+
+/*
+        Make the name of entry `index' in a directory.  The index comes
+        first, in base 36, so names in one directory never collide; random
+        letters and digits fill it out to its length.  The letters come from
+        the directory's `salt' and the index, not from the main generator,
+        so the name of an earlier entry can be made again to link to it.
+*/
+
+void MakeName( Shape *shape, unsigned long long salt, long index, char *name )
+{
+   static const char chars[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+   unsigned long long saved = Seed;
+   char digits[16];
+   int n = 0, len, i;
+
+   Seed = ( salt ^ ( (unsigned long long) index * 0x9E3779B97F4A7C15ULL ) ) | 1;
+
+   do
+   {
+      digits[ n++ ] = chars[ index % 36 ];
+      index /= 36;
+   } while( index > 0 );
+
+   len = (int) Between( shape->minname, shape->maxname );
+   if( len < n + 1 )
+      len = n + 1;
+
+   for( i = 0; i < n; i++ )
+      name[i] = digits[ n - 1 - i ];
+   name[ n ] = '_';
+   for( i = n + 1; i < len; i++ )
+      name[i] = chars[ Random() % 36 ];
+   name[ len ] = 0;
+
+   Seed = saved;
+}
+
+/*
+        Make one file of a random size.
+*/
+
+void MakeFile( Shape *shape, char *name, Built *built )
+{
+   static char block[65536];
+   unsigned long long size, left;
+   double lo, hi;
+   size_t n;
+   int fd;
+
+   lo   = log( (double) shape->minsize + 1.0 );
+   hi   = log( (double) shape->maxsize + 1.0 );
+   size = (unsigned long long)( exp( lo + ( hi - lo ) * Uniform() ) - 1.0 );
+
+   if( -1 == ( fd = open( name, O_WRONLY | O_CREAT | O_EXCL, 0644 ) ) )
+   {
+      perror( name );
+      exit(1);
+   }
+
+   if( shape->data )
+   {
+      memset( block, 'e', sizeof(block) );
+      for( left = size; left > 0; left -= n )
+      {
+         n = left > sizeof(block) ? sizeof(block) : (size_t) left;
+         if( write( fd, block, n ) != (ssize_t) n )
+         {
+            perror( name );
+            exit(1);
+         }
+      }
+   }
+   else if( ftruncate( fd, (off_t) size ) == -1 )
+   {
+      perror( name );
+      exit(1);
+   }
+
+   close( fd );
+   built->files++;
+   built->bytes += size;
+}
+
+/*
+        Fill the current directory, then build each subdirectory in turn.
+        The recursion goes no deeper than /depth, and each level works in
+        its own directory, so paths never get long.
+*/
+
+void Build( Shape *shape, int level, Built *built )
+{
+   char name[ MAX_NAME + 1 ], target[ MAX_NAME + 1 ];
+   unsigned long long salt = Random();
+   long files, i, entries = 0, lastfile = -1;
+   int d;
+
+   files = shape->minfiles +
+           (long)( (double)( shape->maxfiles - shape->minfiles + 1 ) * pow( Uniform(), shape->skew ) );
+   if( files > shape->maxfiles )
+      files = shape->maxfiles;
+
+   for( i = 0; i < files; i++ )
+   {
+      MakeName( shape, salt, entries, name );
+
+      if( entries > 0 && (int)( Random() % 100 ) < shape->symlinks )
+      {
+         MakeName( shape, salt, (long)( Random() % (unsigned long long) entries ), target );
+         if( symlink( target, name ) == -1 )
+         {
+            perror( name );
+            exit(1);
+         }
+         built->symlinks++;
+      }
+      else if( lastfile >= 0 && (int)( Random() % 100 ) < shape->links )
+      {
+         MakeName( shape, salt, lastfile, target );
+         if( link( target, name ) == -1 )
+         {
+            perror( name );
+            exit(1);
+         }
+         built->links++;
+      }
+      else
+      {
+         MakeFile( shape, name, built );
+         lastfile = entries;
+      }
+      entries++;
+   }
+
+   if( level >= shape->depth )
+      return;
+
+   for( d = 0; d < shape->fanout; d++ )
+   {
+      MakeName( shape, salt, entries++, name );
+      if( mkdir( name, 0755 ) == -1 || chdir( name ) == -1 )
+      {
+         perror( name );
+         exit(1);
+      }
+      built->dirs++;
+
+      Build( shape, level + 1, built );
+
+      if( chdir( ".." ) == -1 )
+      {
+         perror( ".." );
+         exit(1);
+      }
+   }
+}
+
+/*
+        Options are given as in EDU: /name=value or -name=value.
+*/
+
+int isOptionChar( char c )
+{
+   return( c == '/' || c == '-' );
+}
+
+int isOption( char *arg, char *name )
+{
+   if( !isOptionChar( arg[0] ) )
+      return( FALSE );
+
+   for( arg++; *name != 0 && toupper( *arg ) == toupper( *name ); arg++, name++ )
+      ;
+
+   return( *name == 0 && ( *arg == 0 || *arg == '=' ) );
+}
+
+/*
+        Read `=MIN..MAX', or `=N' for both.
+*/
+
+void Range( char *arg, unsigned long long *min, unsigned long long *max )
+{
+   char *p = strchr( arg, '=' ), *dots;
+
+   if( p == NULL )
+   {
+      fprintf(stderr,"edutree: %s needs a value.\n", arg );
+      exit(1);
+   }
+   *min = *max = strtoull( p + 1, NULL, 10 );
+   if( NULL != ( dots = strstr( p, ".." ) ) )
+      *max = strtoull( dots + 2, NULL, 10 );
+   if( *max < *min )
+   {
+      fprintf(stderr,"edutree: Invalid range in %s.\n", arg );
+      exit(1);
+   }
+}
+
+long Number( char *arg )
+{
+   char *p = strchr( arg, '=' );
+
+   if( p == NULL )
+   {
+      fprintf(stderr,"edutree: %s needs a value.\n", arg );
+      exit(1);
+   }
+   return( atol( p + 1 ) );
+}
+
+int main( int argc, char *argv[] )
+{
+   Shape shape;
+   Built built;
+   char *dirname = NULL;
+   unsigned long long min, max;
+   int i;
+
+   shape.fanout   = 4;
+   shape.depth    = 4;
+   shape.minfiles = 0;
+   shape.maxfiles = 32;
+   shape.skew     = 2.0;
+   shape.minsize  = 0;
+   shape.maxsize  = 1048576;
+   shape.minname  = 4;
+   shape.maxname  = 16;
+   shape.links    = 0;
+   shape.symlinks = 0;
+   shape.data     = FALSE;
+
+   for( i = 1; i < argc; i++ )
+   {
+      if( isOption( argv[i], "fanout" ) )
+         shape.fanout = (int) Number( argv[i] );
+      else if( isOption( argv[i], "depth" ) )
+         shape.depth = (int) Number( argv[i] );
+      else if( isOption( argv[i], "files" ) )
+      {
+         Range( argv[i], &min, &max );
+         shape.minfiles = (long) min;
+         shape.maxfiles = (long) max;
+      }
+      else if( isOption( argv[i], "skew" ) )
+         shape.skew = atof( strchr( argv[i], '=' ) ? strchr( argv[i], '=' ) + 1 : "1" );
+      else if( isOption( argv[i], "size" ) )
+         Range( argv[i], &shape.minsize, &shape.maxsize );
+      else if( isOption( argv[i], "names" ) )
+      {
+         Range( argv[i], &min, &max );
+         shape.minname = (int) min;
+         shape.maxname = (int) max;
+      }
+      else if( isOption( argv[i], "links" ) )
+         shape.links = (int) Number( argv[i] );
+      else if( isOption( argv[i], "symlinks" ) )
+         shape.symlinks = (int) Number( argv[i] );
+      else if( isOption( argv[i], "data" ) )
+         shape.data = TRUE;
+      else if( isOption( argv[i], "seed" ) )
+         Seed = (unsigned long long) Number( argv[i] );
+      else
+         dirname = argv[i];
+   }
+
+   if( dirname == NULL )
+   {
+      fprintf(stderr,"edutree: No directory name given.\n" );
+      exit(1);
+   }
+   if( shape.fanout < 0 || shape.depth < 0 || shape.skew <= 0.0 ||
+       shape.minname < 1 || shape.maxname > MAX_NAME - 16 ||
+       shape.links < 0 || shape.links > 100 || shape.symlinks < 0 || shape.symlinks > 100 )
+   {
+      fprintf(stderr,"edutree: Invalid tree shape.\n" );
+      exit(1);
+   }
+   if( Seed == 0 )
+      Seed = 1;
+
+   if( mkdir( dirname, 0755 ) == -1 || chdir( dirname ) == -1 )
+   {
+      perror( dirname );
+      exit(1);
+   }
+
+   memset( &built, 0, sizeof(built) );
+   built.dirs = 1;
+
+   Build( &shape, 0, &built );
+
+   printf( "%llu directories, %llu files, %llu hard links, %llu symbolic links, %llu bytes\n",
+           built.dirs, built.files, built.links, built.symlinks, built.bytes );
+   return 0;
+}
@@ -0,0 +1,55 @@
+#!/bin/sh
+#
+#  samecount.sh - Check that edu.c and EDU.cpp count a tree alike.
+#
+#  The two programs have separate engines (edu.c its own, EDU.cpp the one
+#  in libedu.hpp), so a change to how one counts can leave the other
+#  behind.  This builds both and runs each with /units=B /both on every
+#  tree given, which prints exact file lengths and allocated bytes for
+#  every directory.  The outputs must be the same line for line apart from
+#  the padding; the first difference is shown and the exit status is 1.
+#  Each tree is scanned from its parent directory, since both programs
+#  take an argument starting with / for an option.
+#
+#  Usage:
+#         samecount.sh tree...
+#
+#  BENCH_DIR (default /tmp/edu-bench) holds the binaries.  CC and CXX pick
+#  the compilers.  bench.sh runs this on its trees before timing them.
+#
+
+set -e
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+BENCH_DIR=${BENCH_DIR:-/tmp/edu-bench}
+CC=${CC:-cc}
+CXX=${CXX:-c++}
+
+if [ $# -eq 0 ]
+then
+   echo "usage: samecount.sh tree..." >&2
+   exit 2
+fi
+
+mkdir -p "$BENCH_DIR"
+BENCH_DIR=$(cd "$BENCH_DIR" && pwd)
+$CC  -O2 -pthread -o "$BENCH_DIR/edu"    "$HERE/../edu.c"
+$CXX -O2          -o "$BENCH_DIR/educpp" "$HERE/../EDU.cpp"
+
+status=0
+for t in "$@"
+do
+   dir=$(dirname "$t")
+   name=$(basename "$t")
+   (cd "$dir" && "$BENCH_DIR/edu"    /units=B /both "$name") | awk '{ $1 = $1 } 1' > "$BENCH_DIR/samecount.c"
+   (cd "$dir" && "$BENCH_DIR/educpp" /units=B /both "$name") | awk '{ $1 = $1 } 1' > "$BENCH_DIR/samecount.cpp"
+   if cmp -s "$BENCH_DIR/samecount.c" "$BENCH_DIR/samecount.cpp"
+   then
+      echo "samecount.sh: $t: same"
+   else
+      echo "samecount.sh: $t: edu.c and EDU.cpp differ" >&2
+      diff "$BENCH_DIR/samecount.c" "$BENCH_DIR/samecount.cpp" | head -10 >&2
+      status=1
+   fi
+done
+exit $status
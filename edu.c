@@ -58,6 +58,12 @@ UNIX Users:
   Note:  The '/' and '-' option start characters are synonymous and here for
          various operating systems that use different ones by convention.
 
+  Note:  Options that cannot be used together are refused before anything
+         is read when the one left out would change what is counted or
+         printed, such as /cache with /dedupe-links or /sort=size with
+         /format=bin.  When it would only change how fast, such as
+         /threads with /estimate, it is ignored with a warning.
+
   Usage: 
          edu [/total_only] [/help] [dirname]
 
@@ -67,7 +73,223 @@ UNIX Users:
          /help
          /h                Displays the usage message.
 
-         /level=1..999     Level which to display directories:
+         /threads=N        Scan with N worker threads (UNIX only).  Without
+                           =N, one thread per processor.  Output is the
+                           same as the single threaded scan.
+
+         /stats            Report scan counters on stderr when done
+                           (UNIX only).
+
+         /cache=FILE       Keep an index of every directory in FILE and, on
+                           the next run, reuse the file totals of each
+                           directory whose modification and change times
+                           are the same (UNIX only).  A file rewritten in
+                           place does not change its directory's times, so
+                           its new size is not seen until the directory
+                           itself changes.
+
+         /watch=SECONDS    After the listing, keep watching the tree with
+                           inotify and every SECONDS (default 10) print
+                           how much each changed directory grew or shrank,
+                           as +/-XXX.XX Megabytes in DIRECTORYNAME (Linux
+                           only).  With /total_only, only the overall
+                           change.
+
+         /serve=SOCKET     Scan the tree once, keep it in memory, and stay
+                           running to answer /query on the Unix domain
+                           socket SOCKET, without printing a listing
+                           (Linux only).  The tree is kept up to date with
+                           inotify as for /watch, a little at a time
+                           between questions.  Stopped by SIGINT or
+                           SIGTERM, which removes SOCKET.
+
+         /refresh=SECONDS  With /serve, also read the whole tree again
+                           every SECONDS, for changes inotify does not
+                           see, such as ones made from other hosts on a
+                           shared mount.
+
+         /query=SOCKET     Ask a /serve for dirname's total, or with
+                           /sort=size its subdirectories largest first, or
+                           with /top=N the N largest of it and the
+                           directories below it, as /top ranks a scan, and
+                           print the answer as a listing would be.
+                           dirname is given as the server prints it, give
+                           or take `.' names and extra delimiters; with
+                           none, the whole served tree.
+
+         /dedupe-links     Count a file with several hard links once, under
+                           the first name found, instead of once per link
+                           (UNIX only).  With /threads it is the same name,
+                           so every directory's total is as without.  Not
+                           used with /cache or /watch.
+
+         /allocated        Report the space allocated on disk (st_blocks)
+                           rather than file sizes, so sparse and compressed
+                           files count for what they really use (UNIX
+                           only).
+
+         /both             Report file sizes and allocated space, from the
+                           same pass, as
+                           XXX.XX Megabytes YYY.YY allocated in DIRECTORYNAME
+
+         /xdev             Stay on the device dirname is on: directories
+                           mounted from other devices, such as /proc or
+                           network mounts below /, are left out (UNIX
+                           only).
+
+         /device-threads=N With /threads, let no more than N threads read
+                           directories on any one device at a time, so a
+                           slow device holds at most N threads and the
+                           rest carry on with the others (UNIX only).
+                           Implies /threads.
+
+         /inode-order      Stat the entries of each directory, and go into
+                           its subdirectories, in inode number order
+                           rather than the order the directory lists them
+                           (UNIX only).  On rotational disks this turns
+                           the seeks between inodes into a sweep across
+                           the disk.  On SSDs, or with the inodes already
+                           cached, there are no seeks to save and the
+                           sorting costs a little time.
+                           The listing follows the same order, so add
+                           /sort=name for one that does not change.
+
+         /uring=N          Stat files through io_uring, with up to N
+                           (default 64) stats in flight per thread rather
+                           than one at a time, which hides the round trips
+                           of network filesystems such as NFS (Linux
+                           only).  Without io_uring in the kernel, files
+                           are stat'ed one at a time as usual.
+
+         /exclude=GLOB     Leave out files and directories whose name
+                           matches GLOB; an excluded directory is never
+                           opened.  GLOB is matched against names, not
+                           paths, with *, ?, [abc], [a-z] and [!abc], and
+                           * matches leading dots too.  May be given more
+                           than once (UNIX only).
+
+         /include=GLOB     Count only files whose name matches GLOB, or
+                           any of them if given more than once.
+                           Directories are still descended unless
+                           excluded, and /exclude wins over /include
+                           (UNIX only).  Neither is used with /cache.
+
+         /sort=size
+         /sort=name        List the directories largest first, or by name
+                           with each directory before those under it,
+                           instead of in the order they are finished
+                           (UNIX only).  The tree is kept in memory until
+                           the scan is done.
+
+         /top=N            List only the N largest directories, largest
+                           first, or by name with /sort=name (UNIX only).
+                           Only those N are kept in memory.
+
+         /format=ndjson
+         /format=csv
+         /format=bin       Write each directory as a record of exact byte
+                           counts, file count, depth and path, as JSON
+                           lines, CSV, or length prefixed binary records
+                           (UNIX only).  See FORMAT_* below.  =bin is not
+                           used with /sort=size or /top, since /diff only
+                           takes a whole snapshot in name order.
+
+         /diff=SNAPSHOT    Compare the tree with SNAPSHOT, the saved output
+                           of an earlier edu /sort=name /format=bin, and
+                           print each directory that changed as
+                           +/-XXX.XX Megabytes +/-N files in DIRECTORYNAME,
+                           most grown first (UNIX only).  Directories are
+                           matched by their path below dirname, so the two
+                           need not start from the same place.  /top=N
+                           prints only the first N.  If dirname is itself a
+                           snapshot file, the two files are compared
+                           without scanning anything.  Memory use does not
+                           grow with the size of the snapshot, only with
+                           the number of changed directories.
+
+         /units=B|K|M|G|T|auto
+                           Print sizes in bytes, exactly, or in kilo-,
+                           mega- (the default), giga- or terabytes of 1024
+                           of the one before; auto picks, line by line,
+                           the largest unit the size is at least one of.
+                           Sizes are counted in bytes either way; this
+                           only changes how they are printed.
+
+         /histogram        Also print, under each directory, how many of its
+                           files and how much of its size fall in each
+                           size bucket (0, <2, <4 .. <1K .. <1T, >=1T), by
+                           time since last modified and by time since last
+                           read (<1d, <7d, <30d, <90d, <180d, <1y, <2y,
+                           >=2y), one line per bucket that has any files
+                           (UNIX only).  With /total_only, /sort or /top,
+                           only the whole tree's buckets are printed, at
+                           the end.  Gathered from the same stat calls, so
+                           the scan costs about the same.  Not used with
+                           /format, /diff or /cache.
+
+         /by-owner
+         /by-owner=group   Also print the files and size the whole tree
+         /by-owner=dirs    holds for each user, largest first, by name
+                           where the id has one, after the listing (UNIX
+                           only).  =group sums by group instead of by
+                           user; the two are not printed together.  =dirs
+                           also prints them under each directory, as
+                           /histogram does, and may follow either, as in
+                           /by-owner=group,dirs.  As with /histogram, only
+                           the whole tree's with /total_only, /sort or
+                           /top, and not used with /format, /diff or
+                           /cache.  Both may be given together.
+
+         /duplicates       After the listing, print the files whose
+                           contents are the same, in groups, those
+                           wasting the most bytes first: the bytes the
+                           extra copies take, then each copy's path
+                           (UNIX only).  Sizes are noted during the scan;
+                           files of a size seen more than once have their
+                           first and last 4K hashed, those still matching
+                           are hashed whole, and files are only reported
+                           as copies once their bytes have been compared,
+                           all on /threads threads or one per CPU.  Hard links to one file are
+                           listed once, not as copies.  Not used with
+                           /format, /diff, /cache, /shard or /merge.
+
+         /estimate
+         /estimate=PERCENT Print only an estimate of the total, within
+                           PERCENT of it at 95% confidence (default 5),
+                           and the margin (UNIX only).  The top levels are
+                           counted in full, down to /level if given, and
+                           random walks down the tree below them are
+                           weighted by fan-out and extrapolated until the
+                           margin is small enough.  Each directory is read
+                           at most once, so on a huge tree only a small
+                           part of it is read; on a small one it may all
+                           be, and the total is then exact.  Serial; not
+                           used with /threads, /cache, /dedupe-links,
+                           /sort, /top, /format, /diff, /histogram or
+                           /by-owner.
+
+         /shard=K/N        Scan only shard K of N and write it to standard
+                           output as a /sort=name /format=bin file for
+                           /merge (UNIX only).  The directories at level
+                           /shard-depth are dealt out by a hash of their
+                           path below dirname, so N processes, on one host
+                           or on several sharing the mount, each scan
+                           about 1/N of the tree.  The levels above are
+                           read by every shard.  Hard links between shards
+                           are counted in each, even with /dedupe-links.
+
+         /shard-depth=D    The level dealt out by /shard (default 2, the
+                           subdirectories of dirname).  All shards of one
+                           scan must use the same.
+
+         /merge FILE...    Put the N files of one /shard=K/N scan back
+                           together and list the exact totals of every
+                           directory, parents first, as if the tree had
+                           been scanned in one go.  Every shard must be
+                           given, once each.  /level, /total_only, /sort,
+                           /top, /format and /diff apply as to a scan.
+
+         /level=1..999    Level which to display directories:
                            ;   .     = 1
                            ;   ./a   = 2
                            ;   ./a/a = 3
@@ -102,6 +324,10 @@ Building EDU from source on a UNIX machine:
   You must define UNIX when compiling.  For example:
       cc -DUNIX edu.c
 
+  libedu.hpp holds the engine of EDU.cpp, the C++ port; this program does
+  not use it.  A change to how files are counted belongs in both, and
+  bench/samecount.sh checks that they print the same totals for a tree.
+
 Building EDU from source on a non-UNIX machine:
 
         Windows 95 with Microsoft Visual C++, you must define WIN95:
@@ -144,15 +370,42 @@ Contributors:
 ******************************************************************************************/
 #define UNIX
 
+#if defined(UNIX) && defined(__linux__)
+#define _GNU_SOURCE                             /* statx() */
+#endif
+
 #include<stdio.h>
 #include<stdlib.h>
 #include<ctype.h>
 #include<string.h>
 #include<sys/types.h>
 #include<sys/stat.h>
+#include<errno.h>
 
 #ifdef UNIX
 #include<dirent.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<pthread.h>
+#include<sys/resource.h>
+#include<sys/mman.h>
+#include<pwd.h>
+#include<grp.h>
+#include<time.h>
+#endif
+
+#ifdef __linux__
+#include<sys/syscall.h>
+#include<sys/sysmacros.h>
+#include<sys/inotify.h>
+#include<sys/socket.h>
+#include<sys/un.h>
+#include<poll.h>
+#include<signal.h>
+#if defined(__NR_io_uring_setup) && defined(STATX_SIZE)
+#include<linux/io_uring.h>
+#define HAVE_URING
+#endif
 #endif
 
 #ifndef _MAX_FNAME
@@ -174,260 +427,7784 @@ Contributors:
 #define MAXPATHLEN 257
 #endif
 
-/* Keep total by Megabyte.Byte */
+/*
+        Totals are kept as exact byte and file counts, 64 bits wide, so no
+        file is too large and adding one total into another is three
+        additions.  Nothing is turned into megabytes until it is printed.
+*/
+
+#ifdef WIN95
+typedef unsigned __int64      Counter;
+#else
+typedef unsigned long long    Counter;
+#endif
 
 typedef struct total{
-                         unsigned long  Megabytes;
-                         unsigned long  Bytes;
+                         Counter  Bytes;       /* st_size         */
+                         Counter  Allocated;   /* st_blocks * 512 */
+                         Counter  Files;       /* files counted   */
 
                     } Total;
 
+/* Which sizes are printed (/allocated, /both).  Both are always summed. */
+
+#define SIZE_APPARENT         1
+#define SIZE_ALLOCATED        2
+#define SIZE_BOTH             ( SIZE_APPARENT | SIZE_ALLOCATED )
+
+/* The unit sizes are printed in (/units).  Megabytes unless asked. */
+
+#define UNIT_B                0
+#define UNIT_K                1
+#define UNIT_M                2
+#define UNIT_G                3
+#define UNIT_T                4
+#define UNIT_AUTO            -1         /* the largest that gives >= 1 */
+
+static const char  *UnitNames[] = { "Bytes", "Kilobytes", "Megabytes", "Gigabytes", "Terabytes" };
+static const double UnitSizes[] = { 1.0, 1024.0, (double) MEGABYTE, 1073741824.0, 1099511627776.0 };
 
 /*
-        Given megabytes and bytes, add them to the Total number.
+        Add one Total into another.
 */
 
-void Add( 
-         unsigned long megs,           /* pass        */
-         unsigned long bytes,          /* pass        */
-         Total *number                 /* pass/return */ 
-        )
+void AddTotal( Total *from, Total *number )
 {
-   number->Bytes += bytes;
-   number->Megabytes += megs;
-
-   while( number->Bytes > MEGABYTE )
-   {
-      number->Megabytes++;
-      number->Bytes -= MEGABYTE;
-   }
+   number->Bytes     += from->Bytes;
+   number->Allocated += from->Allocated;
+   number->Files     += from->Files;
 }
 
 /*
-  This is the main totalling engine.  This recursive procedure takes
-  a directory name, and will total all directories recursively. 
+        The unit to print `bytes' in.
+*/
 
-  A lot of hacking had to be done for the Windows 95 environment with
-  Visual C++.  They just don't want you to be able to port a program
-  from some other environment.  I think people call it.... Proprietary.
+int UnitOf( Counter bytes, int Units )
+{
+   int unit = UNIT_B;
+
+   if( Units != UNIT_AUTO )
+      return( Units );
 
+   while( unit < UNIT_T && (double) bytes >= UnitSizes[ unit + 1 ] )
+      unit++;
+   return( unit );
+}
+
+/*
+        Format a size in `unit' into `buf': exact digits for bytes, else
+        two decimals.  With `sign' it is a change, led by + or - as
+        `negative' says, and one place wider.
 */
-   
-Total DirectoryTotal( char *dirname, int total_only, char PathDelimiter, int RecursionLevel, int RecursionLimit )
+
+char *FormatSize( Counter bytes, int negative, int sign, int unit, char *buf )
 {
+   char digits[24], *p = digits + sizeof(digits);
+   int width = sign ? 7 : 6;
 
-#ifdef UNIX 
+   if( unit != UNIT_B )
+   {
+      sprintf( buf, sign ? "%+7.2lf" : "%6.2lf", ( negative ? -1.0 : 1.0 ) * (double) bytes / UnitSizes[ unit ] );
+      return( buf );
+   }
 
-   DIR *mydir;
-   struct dirent *fbuf;
-   struct stat statbuf;
+   *--p = 0;
+   do
+   {
+      *--p = (char)( '0' + (int)( bytes % 10 ) );
+      bytes /= 10;
+   } while( bytes != 0 );
+   if( sign )
+      *--p = negative ? '-' : '+';
 
-#else                                                   /* Windows 95 */
+   sprintf( buf, "%*s", width, p );
+   return( buf );
+}
 
-  long   SearchHandle;
-  int    Status;
-  char   EffectivePath[_MAX_FNAME];
-  struct _finddata_t FileInfo;
+/*
+        Print one directory line, or the overall total if `dirname' is NULL.
+        Every engine prints through here so that their output is identical.
+        With /both the allocated size follows the apparent one, in the same
+        unit.
+*/
 
-#endif
+void PrintTotal( Total *number, int Sizes, int Units, char *dirname )
+{
+   Counter shown = ( Sizes == SIZE_ALLOCATED ) ? number->Allocated : number->Bytes;
+   int unit = UnitOf( shown, Units );
+   char a[32], b[32];
 
-   char filespec[MAXPATHLEN];
-   char newdir[MAXPATHLEN];
+   if( Sizes == SIZE_BOTH )
+      printf( "%s %s %s allocated", FormatSize( number->Bytes, FALSE, FALSE, unit, a ), UnitNames[ unit ],
+              FormatSize( number->Allocated, FALSE, FALSE, unit, b ) );
+   else
+      printf( "%s %s", FormatSize( shown, FALSE, FALSE, unit, a ), UnitNames[ unit ] );
 
-   Total DirTotal = {0,0};
-   Total TempTotal = {0,0};
+   if( dirname != NULL )
+      printf( " in %-s\n", dirname );
+   else
+      printf( "\n" );
+}
 
-#ifdef UNIX  /* UNIX, DOS, or OS/2 */
+/*
+        Print a change of `change' bytes, as +/-XXX.XX Megabytes, without
+        the line's end.
+*/
 
-   if( NULL == ( mydir = opendir( dirname ) ) )
-   {
-      fprintf(stderr,"Unable to open directory: %s\n", dirname );
-      perror("opendir:");
-      return (DirTotal);
-   }
+void PrintChange( long long change, int Units )
+{
+   Counter size = (Counter)( change < 0 ? -change : change );
+   int unit = UnitOf( size, Units );
+   char a[32];
 
-   while( NULL != ( fbuf = readdir(mydir) ) )
-   {
-      sprintf(filespec,"%-s%c%-s", dirname, PathDelimiter, fbuf->d_name);
+   printf( "%s %s", FormatSize( size, change < 0, TRUE, unit, a ), UnitNames[ unit ] );
+}
 
-          /* UNIX supports file `links', do not follow directory links. */
+/*
+        The one size a total is ranked or followed by: allocated with
+        /allocated, else apparent.
+*/
 
-#ifdef UNIX
-      if ( lstat( filespec, &statbuf) == -1 ) 
-      {
-         continue;
-      }
-      if( (statbuf.st_mode & S_IFMT) == S_IFLNK  )
-      {
-         continue;
-      }
-#else /* DOS or OS/2 */
-      if ( stat( filespec, &statbuf) == -1 ) 
-      {
-         continue;
-      }
-#endif
+long long TotalBytes( Total *t, int Sizes )
+{
+   return( (long long)( Sizes == SIZE_ALLOCATED ? t->Allocated : t->Bytes ) );
+}
 
-      if( (statbuf.st_mode & S_IFMT) == S_IFDIR  )
-      {
-         if( fbuf->d_name[0] == '.' ) 
-         {
-            /* "." and ".." are directory names, do not follow them! */
-            
-            if( (fbuf->d_name[1] == 0) || (fbuf->d_name[1] == '.') )
-               continue;
-         }
+/*
+        Return TRUE for the "." and ".." entries, which must not be followed.
+*/
 
-         sprintf(newdir,"%s%c%s", dirname, PathDelimiter, fbuf->d_name );
+int isDotDir( char *name )
+{
+   return ( name[0] == '.' && 
+            ( name[1] == 0 || ( name[1] == '.' && name[2] == 0 ) ) );
+}
 
-         TempTotal = DirectoryTotal( newdir, total_only, PathDelimiter, RecursionLevel + 1 ,RecursionLimit);
+/*
+        Make sure a growable buffer holds at least `need' bytes.
+*/
 
-         Add( TempTotal.Megabytes, (unsigned long ) TempTotal.Bytes, &DirTotal );
-      }
-      else 
+char *Reserve( char **buf, size_t *size, size_t need )
+{
+   if( need > *size )
+   {
+      while( *size < need )
+         *size = *size ? *size * 2 : 256;
+
+      if( NULL == ( *buf = realloc( *buf, *size ) ) )
       {
-         Add( 0, (unsigned long) statbuf.st_size, &DirTotal );
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
       }
    }
+   return( *buf );
+}
 
-#else /* Windows 95 Specific, Damn you Microsoft! */
+/*
+        The path of the directory being totalled, grown and cut back one
+        component at a time as the engines go down and up the tree.  It has
+        no length limit and is only read when a line is printed.
+*/
 
-  sprintf( EffectivePath, "%s\\*.*", dirname );
+typedef struct pathbuf{
+                         char   *buf;
+                         size_t  size;
+                         size_t  len;
 
-  SearchHandle = _findfirst( EffectivePath, &FileInfo );
-   
-  Status = SearchHandle;
+                    } PathBuf;
 
-  while( Status != -1 )
-    {
-      if( FileInfo.attrib == _A_SUBDIR )
-        {
-          if( 0 != strcmp(FileInfo.name, ".") && 0 != strcmp(FileInfo.name, "..") )
-            {
-              sprintf(newdir,"%s%c%s", dirname, PathDelimiter, FileInfo.name );
-              
-              TempTotal = DirectoryTotal( newdir, total_only, PathDelimiter, RecursionLevel + 1, RecursionLimit );
-              
-              Add( TempTotal.Megabytes, (unsigned long ) TempTotal.Bytes, &DirTotal );
-            }
-        }
-      else 
-        {
-          Add( 0, (unsigned long) FileInfo.size, &DirTotal );
-        }
+void PathInit( PathBuf *path, char *dirname )
+{
+   path->buf  = NULL;
+   path->size = 0;
+   path->len  = strlen( dirname );
+   Reserve( &path->buf, &path->size, path->len + 1 );
+   strcpy( path->buf, dirname );
+}
 
-      Status = _findnext( SearchHandle, &FileInfo );
+void PathPush( PathBuf *path, char PathDelimiter, char *name )
+{
+   size_t l = strlen( name );
 
-      sprintf(filespec,"%-s%c%-s", dirname, PathDelimiter, FileInfo.name);
-      
-    }/*while*/
+   Reserve( &path->buf, &path->size, path->len + l + 2 );
+   path->buf[ path->len ] = PathDelimiter;
+   memcpy( path->buf + path->len + 1, name, l + 1 );
+   path->len += l + 1;
+}
 
-#endif /* WIN95; UNIX, DOS or OS/2 */
+void PathPop( PathBuf *path, size_t len )
+{
+   path->len = len;
+   path->buf[ len ] = 0;
+}
 
-  if( total_only == FALSE )
-  {
-     if( RecursionLevel  <= RecursionLimit )
-     printf( "%6.2lf Megabytes in %-s\n", 
-         (double)((double)DirTotal.Megabytes + ((double)DirTotal.Bytes/(double)MEGABYTE)), dirname);
-  }
+/*
+        Compare paths the way the tree is listed by name: a directory comes
+        right before everything under it, so the delimiter sorts before any
+        other character.
+*/
 
-#ifndef WIN95                                   /* UNIX, DOS or OS/2 */
-   closedir( mydir );
-#else                                                   /* Windows 95 */
-  _findclose( SearchHandle );
-#endif
+int ComparePaths( char *a, char *b, char PathDelimiter )
+{
+   unsigned char ca, cb;
 
-   return ( DirTotal );
+   for( ; *a != 0 && *a == *b; a++, b++ )
+      ;
+
+   ca = ( *a == PathDelimiter ) ? 1 : (unsigned char) *a;
+   cb = ( *b == PathDelimiter ) ? 1 : (unsigned char) *b;
+   return( ( ca > cb ) - ( ca < cb ) );
 }
 
 /*
-  Return TRUE if a character is an option character, FALSE otherwise.
+        How to scan, as given on the command line.
 */
 
-int isOptionChar( char c )
+typedef struct scan{
+                         int             total_only;
+                         char            PathDelimiter;
+                         int             RecursionLimit;
+                         int             Threads;  /* 0 = single threaded */
+                         int             ShowStats;
+                         int             Sizes;    /* printed, SIZE_*     */
+                         int             Units;    /* /units, UNIT_*      */
+#ifdef UNIX
+                         struct cache   *cache;    /* /cache, or NULL     */
+                         struct linkset *links;    /* /dedupe-links       */
+                         int             Sort;     /* /sort, SORT_*       */
+                         int             Format;   /* /format, FORMAT_*   */
+                         int             OneFilesystem;  /* /xdev         */
+                         unsigned long long Device;      /* of dirname    */
+                         int             DeviceThreads;  /* 0 = no limit  */
+                         int             InodeOrder;     /* /inode-order  */
+                         int             UringDepth;     /* /uring, or 0  */
+                         int             Details;        /* DETAIL_*      */
+                         int             Histogram;      /* /histogram    */
+                         int             ByOwner;        /* OWNER_*, or 0 */
+                         int             OwnerDirs;      /* ,dirs given   */
+                         long long       Now;            /* ages from     */
+                         int             Shard;          /* /shard K - 1  */
+                         int             Shards;         /* N, or 0       */
+                         int             ShardDepth;     /* level dealt   */
+                         int             Duplicates;     /* /duplicates   */
+                         struct matcher *exclude;  /* /exclude, or NULL   */
+                         struct matcher *include;  /* /include, or NULL   */
+                         struct results *results;  /* /sort, or NULL      */
+                         struct top     *top;      /* /top, or NULL       */
+                         struct diff    *diff;     /* /diff, or NULL      */
+#endif
+
+                    } Scan;
+
+#ifdef UNIX
+
+/*
+        Machine readable output (/format).  Each directory becomes one record
+        of its exact apparent and allocated byte counts, the number of files
+        counted, its depth (the starting directory is 1, as for /level) and
+        its path:
+
+        ndjson   {"bytes":B,"allocated":A,"files":F,"depth":D,"path":"P"}
+                 with " \ and control characters in P escaped; other bytes
+                 are passed through as they are in the name.
+        csv      a header line, then B,A,F,D,P with P quoted when it holds
+                 a comma, quote or line break.
+        bin      the 8 bytes "EDUBIN1", then one BinRec per directory
+                 followed by P, a NUL, and padding to a multiple of 8, all
+                 in the machine's byte order.  `length' is the whole record,
+                 so a reader can step from one record to the next without
+                 looking at the path.  `shard' is 0, except in the top
+                 directory's record of a /shard=K/N file, where it is
+                 /shard-depth << 24 | K << 12 | N.
+
+        Records are built in one large buffer with no stdio formatting and
+        written out whenever it fills.
+*/
+
+#define FORMAT_TEXT           0
+#define FORMAT_NDJSON         1
+#define FORMAT_CSV            2
+#define FORMAT_BIN            3
+
+#define BIN_MAGIC             "EDUBIN1"
+#define OUT_BUFFER            ( 1 << 20 )
+
+typedef struct binrec{
+                         unsigned int       length;     /* of the record   */
+                         unsigned int       depth;
+                         unsigned long long bytes;
+                         unsigned long long allocated;
+                         unsigned long long files;
+                         unsigned int       pathlen;    /* without the NUL */
+                         unsigned int       shard;
+
+                    } BinRec;
+
+static char   OutBuf[ OUT_BUFFER ];
+static size_t OutLen;
+
+void OutFlush( void )
 {
-   if( c == '/' || c == '-' )
+   size_t done = 0;
+   ssize_t n;
+
+   while( done < OutLen )
    {
-      return TRUE;
+      if( 0 >= ( n = write( 1, OutBuf + done, OutLen - done ) ) )
+      {
+         if( n == -1 && errno == EINTR )
+            continue;
+         perror( "edu: write" );
+         exit(1);
+      }
+      done += (size_t) n;
    }
-   else
+   OutLen = 0;
+}
+
+void OutBytes( const char *p, size_t len )
+{
+   size_t n;
+
+   while( len > 0 )
    {
-      return FALSE;
+      if( OutLen == OUT_BUFFER )
+         OutFlush();
+      n = OUT_BUFFER - OutLen;
+      if( n > len )
+         n = len;
+      memcpy( OutBuf + OutLen, p, n );
+      OutLen += n;
+      p      += n;
+      len    -= n;
    }
 }
 
-
-int main( int argc, char *argv[] )
+void OutNumber( unsigned long long v )
 {
-   char path[MAXPATHLEN] = ".";
-   int total_only;
-   Total OverallTotal;
-   char PathDelimiter;
-   int  RecursionLimit;
+   char digits[24];
+   char *p = digits + sizeof(digits);
 
-#ifdef UNIX
-      PathDelimiter  =  '/';
-#else
-      PathDelimiter  = '\\';
-#endif
+   do
+   {
+      *--p = (char)( '0' + v % 10 );
+      v /= 10;
+   } while( v != 0 );
 
-   RecursionLimit = 999;   /* Displays information for . (1) and the immediate subdirs ./a (2) */
+   OutBytes( p, (size_t)( digits + sizeof(digits) - p ) );
+}
 
-   total_only = FALSE;
+/*
+        A path as a JSON string body: runs of plain bytes are copied whole.
+*/
 
-   while( --argc )
+void OutJson( const char *p, size_t len )
+{
+   static const char hex[] = "0123456789abcdef";
+   char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+   size_t run = 0;
+   unsigned char c;
+
+   for( ; len > 0; len--, p++ )
    {
-      if( isOptionChar(argv[argc][0])  &&  toupper( argv[argc][1] ) == 'H' )
-      {
-         puts( "\nExtended Disk Usage 1.2  1993-96 Kenneth DeGrant\n\n"
-               "edu [/total_only]         ; Displays the overall total only\n"
-               "    [/help]               ; Displays this help message\n"
-               "    [/level=1..999]       ; Level to display directories:\n"
-               "                          ;   .     = 1\n"
-               "                          ;   ./a   = 2\n"
-               "                          ;   ./a/a = 3\n"
-               "                          ; Default = 999 or all\n"
-               "    [dirname]                                 \n");
-         exit(0);
-      }
-      else if( isOptionChar(argv[argc][0]) && toupper( argv[argc][1] ) == 'T' )
+      c = (unsigned char) *p;
+      if( c >= 0x20 && c != '"' && c != '\\' )
       {
-         total_only = TRUE;
+         run++;
+         continue;
       }
-      else if( isOptionChar(argv[argc][0]) && toupper( argv[argc][1] ) == 'L' )
+      OutBytes( p - run, run );
+      run = 0;
+      if( c == '"' || c == '\\' )
       {
-          char *p = strchr( argv[argc], '=' );
-          if( p == NULL )
-          {
-             RecursionLimit = 999;
-          }
-          else
-          {
-             RecursionLimit = atoi( p + 1);
-          }
-
-          if( RecursionLimit <= 0 || RecursionLimit > 999 )
-          {
-             fprintf(stderr,"edu: Invalid directory display limit of %d.\n", RecursionLimit );
-             exit(1);
-          }
+         esc[1] = (char) c;
+         OutBytes( esc, 2 );
+         esc[1] = 'u';
       }
       else
       {
-         strcpy( path, argv[argc] );
+         esc[4] = hex[ c >> 4 ];
+         esc[5] = hex[ c & 15 ];
+         OutBytes( esc, 6 );
       }
-
    }
+   OutBytes( p - run, run );
+}
 
+/*
+        A path as a CSV field, quoted only if it has to be.
+*/
 
-   OverallTotal =   DirectoryTotal( path, total_only, PathDelimiter, 1, RecursionLimit) ;
+void OutCsv( const char *p, size_t len )
+{
+   size_t i, start;
 
-   if( total_only )
-      printf( "%6.2lf Megabytes\n",
-        (double)((double)OverallTotal.Megabytes+((double)OverallTotal.Bytes/(double)MEGABYTE)));
+   if( NULL == memchr( p, ',', len ) && NULL == memchr( p, '"', len ) &&
+       NULL == memchr( p, '\n', len ) && NULL == memchr( p, '\r', len ) )
+   {
+      OutBytes( p, len );
+      return;
+   }
 
-   return 0;
+   OutBytes( "\"", 1 );
+   for( i = start = 0; i < len; i++ )
+   {
+      if( p[i] == '"' )
+      {
+         OutBytes( p + start, i - start + 1 );
+         start = i;
+      }
+   }
+   OutBytes( p + start, len - start );
+   OutBytes( "\"", 1 );
+}
+
+/*
+        Start the output: the CSV header or the binary magic.
+*/
+
+void FormatBegin( Scan *scan )
+{
+   if( scan->Format == FORMAT_CSV )
+      OutBytes( "bytes,allocated,files,depth,path\n", 33 );
+   else if( scan->Format == FORMAT_BIN )
+      OutBytes( BIN_MAGIC, 8 );
 }
 
+/*
+        Snapshot diff (/diff).  A snapshot is the output of /sort=name
+        /format=bin: every directory once, each before those under it.  The
+        scan being compared is listed in the same order, so the two can be
+        merged as they stream past, one record from each side at a time,
+        with paths compared below their own starting directories.  Nothing
+        of the old snapshot is held but the record being looked at, and of
+        the new scan only directories whose counts changed are kept, to be
+        sorted by growth at the end.  When dirname is itself a snapshot
+        file, both sides are read from disk.
+
+        A directory only on one side counts as zero on the other.  Records
+        deeper than /level, or below the top with /total_only, are passed
+        over on both sides.
+*/
+
+typedef struct snapshot{
+                         int                 fd;
+                         char               *name;
+                         char               *buf;
+                         size_t              size;
+                         size_t              len;
+                         size_t              pos;
+                         BinRec              rec;       /* the current one */
+                         char               *path;
+                         size_t              pathsize;
+                         char               *last;      /* the one before  */
+                         size_t              lastsize;
+                         size_t              rootlen;
+                         unsigned long long  count;
+
+                    } Snapshot;
+
+typedef struct change{
+                         long long           bytes;
+                         long long           allocated;
+                         long long           files;
+                         long long           key;       /* sorted on       */
+                         size_t              offset;    /* of the path     */
+                         char               *path;
+
+                    } Change;
+
+typedef struct diff{
+                         Snapshot            old;
+                         int                 more;      /* old.rec is live */
+                         int                 limit;     /* deepest level   */
+                         char               *root;      /* of the new side */
+                         size_t              rootlen;
+                         Change             *change;
+                         size_t              changes;
+                         size_t              changesize;
+                         char               *paths;
+                         size_t              pathslen;
+                         size_t              pathssize;
+
+                    } Diff;
+
+void SnapOpen( Snapshot *snap, char *name )
+{
+   char magic[8];
+
+   memset( snap, 0, sizeof(Snapshot) );
+   snap->name = name;
+
+   if( -1 == ( snap->fd = open( name, O_RDONLY ) ) )
+   {
+      fprintf(stderr,"edu: Cannot open %s: %s\n", name, strerror( errno ) );
+      exit(1);
+   }
+   if( read( snap->fd, magic, 8 ) != 8 || 0 != memcmp( magic, BIN_MAGIC, 8 ) )
+   {
+      fprintf(stderr,"edu: %s is not a /format=bin file.\n", name );
+      exit(1);
+   }
+   Reserve( &snap->buf, &snap->size, OUT_BUFFER );
+}
+
+void SnapClose( Snapshot *snap )
+{
+   close( snap->fd );
+   free( snap->buf );
+   free( snap->path );
+   free( snap->last );
+}
+
+/*
+        Have at least `need' bytes from pos on in the buffer.  Returns
+        FALSE at the end of the file.
+*/
+
+int SnapFill( Snapshot *snap, size_t need )
+{
+   ssize_t n;
+
+   if( snap->len - snap->pos >= need )
+      return( TRUE );
+
+   memmove( snap->buf, snap->buf + snap->pos, snap->len - snap->pos );
+   snap->len -= snap->pos;
+   snap->pos  = 0;
+   Reserve( &snap->buf, &snap->size, need );
+
+   while( snap->len < need )
+   {
+      if( 0 >= ( n = read( snap->fd, snap->buf + snap->len, snap->size - snap->len ) ) )
+      {
+         if( n == -1 && errno == EINTR )
+            continue;
+         if( n == -1 )
+         {
+            fprintf(stderr,"edu: Cannot read %s: %s\n", snap->name, strerror( errno ) );
+            exit(1);
+         }
+         if( snap->len > 0 )
+         {
+            fprintf(stderr,"edu: %s is cut short.\n", snap->name );
+            exit(1);
+         }
+         return( FALSE );
+      }
+      snap->len += (size_t) n;
+   }
+   return( TRUE );
+}
+
+/*
+        Step to the next record no deeper than `limit', checking on the way
+        that the file is one tree in name order.  Returns FALSE at the end.
+*/
+
+int SnapNext( Snapshot *snap, int limit, char PathDelimiter )
+{
+   char *swap;
+   size_t swapsize;
+
+   while( SnapFill( snap, sizeof(BinRec) ) )
+   {
+      memcpy( &snap->rec, snap->buf + snap->pos, sizeof(BinRec) );
+      if( snap->rec.length % 8 != 0 || snap->rec.length < sizeof(BinRec) + snap->rec.pathlen + 1 ||
+          !SnapFill( snap, snap->rec.length ) )
+      {
+         fprintf(stderr,"edu: %s is damaged.\n", snap->name );
+         exit(1);
+      }
+
+      swap           = snap->last;
+      swapsize       = snap->lastsize;
+      snap->last     = snap->path;
+      snap->lastsize = snap->pathsize;
+      snap->path     = swap;
+      snap->pathsize = swapsize;
+
+      Reserve( &snap->path, &snap->pathsize, snap->rec.pathlen + 1 );
+      memcpy( snap->path, snap->buf + snap->pos + sizeof(BinRec), snap->rec.pathlen );
+      snap->path[ snap->rec.pathlen ] = 0;
+      snap->pos += snap->rec.length;
+
+      if( snap->count++ == 0 )
+      {
+         if( snap->rec.depth != 1 )
+         {
+            fprintf(stderr,"edu: %s does not start with its top directory.\n", snap->name );
+            exit(1);
+         }
+         snap->rootlen = snap->rec.pathlen;
+      }
+      else if( snap->rec.depth <= 1 || ComparePaths( snap->last, snap->path, PathDelimiter ) >= 0 ||
+               0 != memcmp( snap->last, snap->path, snap->rootlen ) )
+      {
+         fprintf(stderr,"edu: %s is not one tree in name order; write it with /sort=name /format=bin.\n", snap->name );
+         exit(1);
+      }
+
+      if( (int) snap->rec.depth <= limit )
+         return( TRUE );
+   }
+   return( FALSE );
+}
+
+void DiffInit( Diff *diff, char *name, int limit, char PathDelimiter )
+{
+   memset( diff, 0, sizeof(Diff) );
+   SnapOpen( &diff->old, name );
+   diff->limit = limit;
+   diff->more  = SnapNext( &diff->old, limit, PathDelimiter );
+}
+
+/*
+        Keep a directory whose counts changed, under the new side's path.
+*/
+
+void DiffNote( Diff *diff, long long bytes, long long allocated, long long files, char *rel )
+{
+   Change *c;
+   size_t len = strlen( rel );
+
+   if( bytes == 0 && allocated == 0 && files == 0 )
+      return;
+
+   Reserve( (char **) &diff->change, &diff->changesize, ( diff->changes + 1 ) * sizeof(Change) );
+   c = &diff->change[ diff->changes++ ];
+   c->bytes     = bytes;
+   c->allocated = allocated;
+   c->files     = files;
+   c->offset    = diff->pathslen;
+
+   Reserve( &diff->paths, &diff->pathssize, diff->pathslen + diff->rootlen + len + 1 );
+   memcpy( diff->paths + diff->pathslen, diff->root, diff->rootlen );
+   memcpy( diff->paths + diff->pathslen + diff->rootlen, rel, len + 1 );
+   diff->pathslen += diff->rootlen + len + 1;
+}
+
+/*
+        The old side's directories that sort before `rel' are gone; the one
+        equal to it, if any, is paired with it.
+*/
+
+void DiffAdd( Diff *diff, char *path, unsigned long long bytes, unsigned long long allocated,
+              unsigned long long files, char PathDelimiter )
+{
+   Snapshot *old = &diff->old;
+   char *rel;
+   int c = 1;
+
+   if( diff->root == NULL )
+   {
+      diff->rootlen = strlen( path );
+      if( NULL == ( diff->root = strdup( path ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+   }
+   if( 0 != memcmp( path, diff->root, diff->rootlen ) )
+   {
+      fprintf(stderr,"edu: %s is not below %s.\n", path, diff->root );
+      exit(1);
+   }
+   rel = path + diff->rootlen;
+
+   while( diff->more && ( c = ComparePaths( old->path + old->rootlen, rel, PathDelimiter ) ) < 0 )
+   {
+      DiffNote( diff, -(long long) old->rec.bytes, -(long long) old->rec.allocated,
+                -(long long) old->rec.files, old->path + old->rootlen );
+      diff->more = SnapNext( old, diff->limit, PathDelimiter );
+   }
+
+   if( diff->more && c == 0 )
+   {
+      DiffNote( diff, (long long)( bytes - old->rec.bytes ), (long long)( allocated - old->rec.allocated ),
+                (long long)( files - old->rec.files ), rel );
+      diff->more = SnapNext( old, diff->limit, PathDelimiter );
+   }
+   else
+      DiffNote( diff, (long long) bytes, (long long) allocated, (long long) files, rel );
+}
+
+/*
+        Feed a whole snapshot file in as the new side.
+*/
+
+void DiffFile( Diff *diff, char *name, char PathDelimiter )
+{
+   Snapshot snap;
+
+   SnapOpen( &snap, name );
+   while( SnapNext( &snap, diff->limit, PathDelimiter ) )
+      DiffAdd( diff, snap.path, snap.rec.bytes, snap.rec.allocated, snap.rec.files, PathDelimiter );
+   SnapClose( &snap );
+}
+
+static char DiffDelimiter;
+
+int CompareChanges( const void *a, const void *b )
+{
+   const Change *x = a, *y = b;
+
+   if( x->key != y->key )
+      return( x->key < y->key ? 1 : -1 );
+   return( ComparePaths( x->path, y->path, DiffDelimiter ) );
+}
+
+/*
+        Finish the merge and print the changes, most grown first, as
+        +/-XXX.XX Megabytes +/-N files in DIRECTORYNAME.  With /top=N only
+        the first N are printed.
+*/
+
+void DiffList( Diff *diff, Scan *scan, size_t max )
+{
+   Change *c;
+   size_t i;
+
+   while( diff->more )
+   {
+      DiffNote( diff, -(long long) diff->old.rec.bytes, -(long long) diff->old.rec.allocated,
+                -(long long) diff->old.rec.files, diff->old.path + diff->old.rootlen );
+      diff->more = SnapNext( &diff->old, diff->limit, scan->PathDelimiter );
+   }
+
+   for( i = 0; i < diff->changes; i++ )
+   {
+      c       = &diff->change[i];
+      c->path = diff->paths + c->offset;
+      c->key  = ( scan->Sizes == SIZE_ALLOCATED ) ? c->allocated : c->bytes;
+   }
+
+   DiffDelimiter = scan->PathDelimiter;
+   qsort( diff->change, diff->changes, sizeof(Change), CompareChanges );
+
+   if( max == 0 || max > diff->changes )
+      max = diff->changes;
+
+   for( i = 0; i < max; i++ )
+   {
+      c = &diff->change[i];
+      PrintChange( c->key, scan->Units );
+      if( scan->Sizes == SIZE_BOTH )
+      {
+         PrintChange( c->allocated, scan->Units );
+         printf( " allocated" );
+      }
+      printf( " %+6lld files in %-s\n", c->files, c->path );
+   }
+
+   SnapClose( &diff->old );
+   free( diff->change );
+   free( diff->paths );
+   free( diff->root );
+}
+
+/*
+        Print one directory in the chosen /format, or as text.
+*/
+
+void PrintLine( Scan *scan, Total *total, char *path, int level )
+{
+   static const char zeros[8];
+   unsigned long long bytes     = total->Bytes;
+   unsigned long long allocated = total->Allocated;
+   size_t len;
+   BinRec rec;
+
+   if( scan->diff != NULL )
+   {
+      DiffAdd( scan->diff, path, bytes, allocated, total->Files, scan->PathDelimiter );
+      return;
+   }
+
+   if( scan->Format == FORMAT_TEXT )
+   {
+      PrintTotal( total, scan->Sizes, scan->Units, path );
+      return;
+   }
+
+   len = strlen( path );
+
+   switch( scan->Format )
+   {
+   case FORMAT_NDJSON:
+      OutBytes( "{\"bytes\":", 9 );
+      OutNumber( bytes );
+      OutBytes( ",\"allocated\":", 13 );
+      OutNumber( allocated );
+      OutBytes( ",\"files\":", 9 );
+      OutNumber( total->Files );
+      OutBytes( ",\"depth\":", 9 );
+      OutNumber( (unsigned long long) level );
+      OutBytes( ",\"path\":\"", 9 );
+      OutJson( path, len );
+      OutBytes( "\"}\n", 3 );
+      break;
+
+   case FORMAT_CSV:
+      OutNumber( bytes );
+      OutBytes( ",", 1 );
+      OutNumber( allocated );
+      OutBytes( ",", 1 );
+      OutNumber( total->Files );
+      OutBytes( ",", 1 );
+      OutNumber( (unsigned long long) level );
+      OutBytes( ",", 1 );
+      OutCsv( path, len );
+      OutBytes( "\n", 1 );
+      break;
+
+   case FORMAT_BIN:
+      memset( &rec, 0, sizeof(rec) );
+      rec.length    = (unsigned int)( ( sizeof(BinRec) + len + 1 + 7 ) & ~(size_t) 7 );
+      rec.depth     = (unsigned int) level;
+      rec.bytes     = bytes;
+      rec.allocated = allocated;
+      rec.files     = total->Files;
+      rec.pathlen   = (unsigned int) len;
+      if( level == 1 && scan->Shards > 0 )
+         rec.shard  = (unsigned int)( scan->ShardDepth << 24 | ( scan->Shard + 1 ) << 12 | scan->Shards );
+      OutBytes( (char *) &rec, sizeof(rec) );
+      OutBytes( path, len );
+      OutBytes( zeros, rec.length - sizeof(rec) - len );
+      break;
+   }
+}
+
+/*
+        Sorted output (/sort, /top).  Rather than printing each directory as
+        it is finished, the engines can hand it to a result tree kept in
+        memory: nodes in one growing array, each holding the index of its
+        parent, its own path component and its totals as plain byte counts.
+        Components are interned, so a name such as "src" is stored once
+        however many directories have it.  Nothing is formatted until the
+        tree is listed at the end.
+
+        /top=N does not keep the tree.  The N largest directories seen so
+        far are held in a min heap with their paths, and every other
+        directory is dropped as soon as it is finished.
+*/
+
+#define SORT_NONE             0
+#define SORT_SIZE             1         /* largest first               */
+#define SORT_NAME             2         /* parents before children     */
+
+#define NO_NODE               0xFFFFFFFFU
+
+typedef struct resultnode{
+                         unsigned long long  bytes;
+                         unsigned long long  allocated;
+                         unsigned long long  files;
+                         unsigned int        parent;    /* or NO_NODE        */
+                         unsigned int        name;      /* offset in names   */
+                         int                 reported;
+
+                    } ResultNode;
+
+typedef struct results{
+                         ResultNode    *node;
+                         size_t         nodes;
+                         size_t         nodesize;
+                         char          *names;     /* interned components   */
+                         size_t         nameslen;
+                         size_t         namessize;
+                         unsigned int  *intern;    /* name offsets, 0 = free */
+                         size_t         internsize;
+                         size_t         interned;
+                         unsigned int  *stack;     /* node of each component */
+                         size_t        *end;       /* of the last path added */
+                         size_t         depth;
+                         size_t         stacksize;
+                         size_t         endsize;
+                         size_t         rootlen;
+
+                    } Results;
+
+typedef struct topentry{
+                         long long      key;
+                         Total          total;
+                         int            level;
+                         char          *path;
+
+                    } TopEntry;
+
+typedef struct top{
+                         TopEntry      *heap;      /* min heap on key       */
+                         size_t         n;
+                         size_t         max;
+                         size_t         size;
+
+                    } Top;
+
+unsigned long long NameHash( char *name, size_t len )
+{
+   unsigned long long h = 0xCBF29CE484222325ULL;
+
+   while( len-- > 0 )
+      h = ( h ^ (unsigned char) *name++ ) * 0x100000001B3ULL;
+   return( h );
+}
+
+void ResultInit( Results *res, char *dirname )
+{
+   memset( res, 0, sizeof(Results) );
+   res->rootlen = strlen( dirname );
+
+          /* Offset 0 is never a name, so 0 can mark a free intern slot. */
+
+   Reserve( &res->names, &res->namessize, 1 );
+   res->names[0] = 0;
+   res->nameslen = 1;
+}
+
+void ResultFree( Results *res )
+{
+   free( res->node );
+   free( res->names );
+   free( res->intern );
+   free( res->stack );
+   free( res->end );
+}
+
+/*
+        Return the offset of `name' in the name store, adding it if it is
+        not there yet.
+*/
+
+unsigned int Intern( Results *res, char *name, size_t len )
+{
+   size_t i, j, newsize;
+   unsigned int *table, off;
+
+   if( ( res->interned + 1 ) * 2 > res->internsize )
+   {
+      newsize = res->internsize ? res->internsize * 2 : 1024;
+      if( NULL == ( table = calloc( newsize, sizeof(unsigned int) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      for( i = 0; i < res->internsize; i++ )
+      {
+         if( 0 != ( off = res->intern[i] ) )
+         {
+            for( j = NameHash( res->names + off, strlen( res->names + off ) ) & ( newsize - 1 );
+                 table[j] != 0; j = ( j + 1 ) & ( newsize - 1 ) )
+               ;
+            table[j] = off;
+         }
+      }
+      free( res->intern );
+      res->intern     = table;
+      res->internsize = newsize;
+   }
+
+   for( i = NameHash( name, len ) & ( res->internsize - 1 ); 0 != ( off = res->intern[i] ); i = ( i + 1 ) & ( res->internsize - 1 ) )
+   {
+      if( 0 == memcmp( res->names + off, name, len ) && res->names[ off + len ] == 0 )
+         return( off );
+   }
+
+   if( res->nameslen + len + 1 > NO_NODE )
+   {
+      fprintf(stderr,"edu: Too many directory names to sort.\n");
+      exit(1);
+   }
+
+   off = (unsigned int) res->nameslen;
+   Reserve( &res->names, &res->namessize, res->nameslen + len + 1 );
+   memcpy( res->names + off, name, len );
+   res->names[ off + len ] = 0;
+   res->nameslen += len + 1;
+
+   res->intern[i] = off;
+   res->interned++;
+   return( off );
+}
+
+/*
+        Add a finished directory to the result tree.  Directories come
+        children first, so the nodes on the way to this one may already be
+        there from the last directory added: those are found by comparing
+        the path with the last one, component by component, and the rest
+        are made here.  The first component is the whole starting dirname.
+*/
+
+void ResultAdd( Results *res, Total *total, PathBuf *path, char PathDelimiter )
+{
+   size_t start = 0, end = res->rootlen, depth = 0;
+   unsigned int n, parent = NO_NODE;
+   char *p;
+
+   for(;;)
+   {
+      n = ( depth < res->depth && res->end[ depth ] == end ) ? res->stack[ depth ] : NO_NODE;
+
+      if( n == NO_NODE || 
+          0 != memcmp( res->names + res->node[n].name, path->buf + start, end - start ) ||
+          res->names[ res->node[n].name + end - start ] != 0 )
+      {
+         if( res->nodes == NO_NODE )
+         {
+            fprintf(stderr,"edu: Too many directories to sort.\n");
+            exit(1);
+         }
+
+         n = (unsigned int) res->nodes++;
+         Reserve( (char **) &res->node, &res->nodesize, res->nodes * sizeof(ResultNode) );
+         memset( &res->node[n], 0, sizeof(ResultNode) );
+         res->node[n].parent = parent;
+         res->node[n].name   = Intern( res, path->buf + start, end - start );
+
+         Reserve( (char **) &res->stack, &res->stacksize, ( depth + 1 ) * sizeof(unsigned int) );
+         Reserve( (char **) &res->end, &res->endsize, ( depth + 1 ) * sizeof(size_t) );
+         res->stack[ depth ] = n;
+         res->end[ depth ]   = end;
+         res->depth          = depth + 1;
+      }
+
+      if( end >= path->len )
+         break;
+
+      parent = n;
+      depth++;
+      start  = end + 1;
+      p      = memchr( path->buf + start, PathDelimiter, path->len - start );
+      end    = ( p == NULL ) ? path->len : (size_t)( p - path->buf );
+   }
+
+          /* Anything below it is finished and will not be seen again. */
+
+   res->depth = depth + 1;
+
+   res->node[n].bytes     = total->Bytes;
+   res->node[n].allocated = total->Allocated;
+   res->node[n].files     = total->Files;
+   res->node[n].reported  = TRUE;
+}
+
+/*
+        Turn a node's counts back into a Total for printing.
+*/
+
+void NodeTotal( ResultNode *node, Total *t )
+{
+   t->Bytes     = node->bytes;
+   t->Allocated = node->allocated;
+   t->Files     = node->files;
+}
+
+/*
+        Put the full path of node `n' in `path', working up from the node.
+        Return its depth.
+*/
+
+int ResultPath( Results *res, unsigned int n, PathBuf *path, char PathDelimiter )
+{
+   size_t len = 0, l;
+   unsigned int m;
+   int level = 0;
+
+   for( m = n; m != NO_NODE; m = res->node[m].parent, level++ )
+      len += strlen( res->names + res->node[m].name ) + 1;
+
+   Reserve( &path->buf, &path->size, len );
+   path->len = len - 1;
+   path->buf[ path->len ] = 0;
+
+   for( m = n; m != NO_NODE; m = res->node[m].parent )
+   {
+      l    = strlen( res->names + res->node[m].name );
+      len -= l + 1;
+      memcpy( path->buf + len, res->names + res->node[m].name, l );
+      if( len > 0 )
+         path->buf[ len - 1 ] = PathDelimiter;
+   }
+   return( level );
+}
+
+typedef struct sizeorder{
+                         long long     key;
+                         unsigned int  node;
+
+                    } SizeOrder;
+
+typedef struct nameorder{
+                         unsigned int  parent;
+                         unsigned int  node;
+                         char         *name;
+
+                    } NameOrder;
+
+int CompareSizes( const void *a, const void *b )
+{
+   const SizeOrder *x = a, *y = b;
+
+   if( x->key != y->key )
+      return( x->key < y->key ? 1 : -1 );
+   return( ( x->node > y->node ) - ( x->node < y->node ) );
+}
+
+int CompareSiblings( const void *a, const void *b )
+{
+   const NameOrder *x = a, *y = b;
+
+   if( x->parent != y->parent )
+      return( x->parent < y->parent ? -1 : 1 );
+   return( strcmp( x->name, y->name ) );
+}
+
+/*
+        List the result tree in the order /sort asked for.
+*/
+
+void ResultList( Results *res, Scan *scan )
+{
+   PathBuf path = { NULL, 0, 0 };
+   Total t;
+   size_t i, count = 0;
+
+   if( res->nodes == 0 )
+      return;
+
+   if( scan->Sort == SORT_SIZE )
+   {
+      SizeOrder *order;
+
+      if( NULL == ( order = malloc( res->nodes * sizeof(SizeOrder) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+
+      for( i = 0; i < res->nodes; i++ )
+      {
+         if( !res->node[i].reported )
+            continue;
+         NodeTotal( &res->node[i], &t );
+         order[ count ].key  = TotalBytes( &t, scan->Sizes );
+         order[ count ].node = (unsigned int) i;
+         count++;
+      }
+
+      qsort( order, count, sizeof(SizeOrder), CompareSizes );
+
+      for( i = 0; i < count; i++ )
+      {
+         int level;
+
+         NodeTotal( &res->node[ order[i].node ], &t );
+         level = ResultPath( res, order[i].node, &path, scan->PathDelimiter );
+         PrintLine( scan, &t, path.buf, level );
+      }
+
+      free( order );
+   }
+   else
+   {
+          /* Sort by parent, then name, so each node's children sit
+             together in order; then walk the tree parents first. */
+
+      NameOrder *order;
+      unsigned int *first, *stack, *owner, n;
+      size_t *pathlen, depth = 0;
+
+      order   = malloc( res->nodes * sizeof(NameOrder) );
+      first   = malloc( res->nodes * sizeof(unsigned int) );
+      stack   = malloc( res->nodes * sizeof(unsigned int) );
+      owner   = malloc( res->nodes * sizeof(unsigned int) );
+      pathlen = malloc( res->nodes * sizeof(size_t) );
+      if( order == NULL || first == NULL || stack == NULL || owner == NULL || pathlen == NULL )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+
+      for( i = 0; i < res->nodes; i++ )
+      {
+         order[i].parent = res->node[i].parent;
+         order[i].node   = (unsigned int) i;
+         order[i].name   = res->names + res->node[i].name;
+         first[i]        = NO_NODE;
+      }
+
+      qsort( order, res->nodes, sizeof(NameOrder), CompareSiblings );
+
+      for( i = res->nodes; i-- > 0; )
+      {
+         if( order[i].parent != NO_NODE )
+            first[ order[i].parent ] = (unsigned int) i;
+      }
+
+          /* The root is the node with no parent, sorted last. */
+
+      n = order[ res->nodes - 1 ].node;
+      ResultPath( res, n, &path, scan->PathDelimiter );
+
+      for(;;)
+      {
+         if( res->node[n].reported )
+         {
+            NodeTotal( &res->node[n], &t );
+            PrintLine( scan, &t, path.buf, (int) depth + 1 );
+         }
+
+         stack[ depth ]   = first[n];
+         owner[ depth ]   = n;
+         pathlen[ depth ] = path.len;
+         depth++;
+
+          /* Next is the first unlisted child of the deepest directory. */
+
+         while( depth > 0 )
+         {
+            i = stack[ depth - 1 ];
+            PathPop( &path, pathlen[ depth - 1 ] );
+
+            if( i < res->nodes && order[i].parent == owner[ depth - 1 ] )
+               break;
+            depth--;
+         }
+         if( depth == 0 )
+            break;
+
+         n = order[i].node;
+         stack[ depth - 1 ] = (unsigned int)( i + 1 );
+         PathPush( &path, scan->PathDelimiter, order[i].name );
+      }
+
+      free( order );
+      free( first );
+      free( stack );
+      free( owner );
+      free( pathlen );
+   }
+
+   free( path.buf );
+}
+
+/*
+        Offer a finished directory to the /top heap.  While the heap is not
+        full everything goes in; after that a directory goes in only if it
+        is larger than the smallest one held, which it replaces.
+*/
+
+void TopAdd( Top *top, Total *total, PathBuf *path, int level, int Sizes )
+{
+   long long key = TotalBytes( total, Sizes );
+   TopEntry e, *h = top->heap;
+   size_t i, c;
+
+   if( top->n == top->max )
+   {
+      if( key <= h[0].key )
+         return;
+      e = h[0];
+      e.key   = key;
+      e.total = *total;
+      e.level = level;
+      if( NULL == ( e.path = realloc( e.path, path->len + 1 ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      memcpy( e.path, path->buf, path->len + 1 );
+
+          /* Sift the new entry down from the root. */
+
+      for( i = 0; ( c = 2 * i + 1 ) < top->n; i = c )
+      {
+         if( c + 1 < top->n && h[ c + 1 ].key < h[c].key )
+            c++;
+         if( h[c].key >= e.key )
+            break;
+         h[i] = h[c];
+      }
+      h[i] = e;
+      return;
+   }
+
+   e.key   = key;
+   e.total = *total;
+   e.level = level;
+   if( NULL == ( e.path = strdup( path->buf ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+
+          /* Sift it up from the end. */
+
+   h = (TopEntry *) Reserve( (char **) &top->heap, &top->size, ( top->n + 1 ) * sizeof(TopEntry) );
+
+   for( i = top->n++; i > 0 && h[ ( i - 1 ) / 2 ].key > e.key; i = ( i - 1 ) / 2 )
+      h[i] = h[ ( i - 1 ) / 2 ];
+   h[i] = e;
+}
+
+static char TopDelimiter;
+
+int CompareTopSizes( const void *a, const void *b )
+{
+   const TopEntry *x = a, *y = b;
+
+   if( x->key != y->key )
+      return( x->key < y->key ? 1 : -1 );
+   return( ComparePaths( x->path, y->path, TopDelimiter ) );
+}
+
+int CompareTopNames( const void *a, const void *b )
+{
+   const TopEntry *x = a, *y = b;
+
+   return( ComparePaths( x->path, y->path, TopDelimiter ) );
+}
+
+/*
+        List what is left in the heap, largest first, or by name with
+        /sort=name.
+*/
+
+void TopList( Top *top, Scan *scan )
+{
+   size_t i;
+
+   TopDelimiter = scan->PathDelimiter;
+   qsort( top->heap, top->n, sizeof(TopEntry), scan->Sort == SORT_NAME ? CompareTopNames : CompareTopSizes );
+
+   for( i = 0; i < top->n; i++ )
+   {
+      PrintLine( scan, &top->heap[i].total, top->heap[i].path, top->heap[i].level );
+      free( top->heap[i].path );
+   }
+   free( top->heap );
+}
+
+/*
+        Size and age histograms (/histogram).  Each file lands in one bucket
+        by its size, a power of two, and in one by how long ago it was
+        modified and one by how long ago it was read.  A bucket is a Total,
+        so it holds bytes, allocated bytes and files like any directory, and
+        adding one histogram into another is adding up Totals.
+
+        Nothing is allocated per file.
+*/
+
+#define SIZE_BUCKETS          42        /* 0, <2, <4 .. <1T, >=1T      */
+#define AGE_BUCKETS           8
+
+static const long long AgeDays[ AGE_BUCKETS - 1 ]  = { 1, 7, 30, 90, 180, 365, 730 };
+static const char     *AgeNames[ AGE_BUCKETS ]     = { "<1d", "<7d", "<30d", "<90d", "<180d", "<1y", "<2y", ">=2y" };
+
+typedef struct histogram{
+                         Total  Size[ SIZE_BUCKETS ];
+                         Total  Modified[ AGE_BUCKETS ];
+                         Total  Accessed[ AGE_BUCKETS ];
+
+                    } Histogram;
+
+Histogram *NewHistogram( void )
+{
+   Histogram *h;
+
+   if( NULL == ( h = calloc( 1, sizeof(Histogram) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   return( h );
+}
+
+/*
+        The bucket for something `seconds' old.  Times in the future count
+        as new.
+*/
+
+int AgeBucket( long long seconds )
+{
+   int b;
+
+   for( b = 0; b < AGE_BUCKETS - 1 && seconds >= AgeDays[b] * 86400; b++ )
+      ;
+   return( b );
+}
+
+/*
+        Add one file, as a Total of one, with its ages in seconds.
+*/
+
+void HistogramAdd( Histogram *h, Total *file, long long modified, long long accessed )
+{
+   int b = ( file->Bytes == 0 ) ? 0 : 64 - __builtin_clzll( file->Bytes );
+
+   if( b >= SIZE_BUCKETS )
+      b = SIZE_BUCKETS - 1;
+
+   AddTotal( file, &h->Size[b] );
+   AddTotal( file, &h->Modified[ AgeBucket( modified ) ] );
+   AddTotal( file, &h->Accessed[ AgeBucket( accessed ) ] );
+}
+
+/*
+        Add one histogram into another.  A directory that could not be read
+        has none.
+*/
+
+void AddHistogram( Histogram *from, Histogram *to )
+{
+   int b;
+
+   if( from == NULL )
+      return;
+
+   for( b = 0; b < SIZE_BUCKETS; b++ )
+      AddTotal( &from->Size[b], &to->Size[b] );
+   for( b = 0; b < AGE_BUCKETS; b++ )
+   {
+      AddTotal( &from->Modified[b], &to->Modified[b] );
+      AddTotal( &from->Accessed[b], &to->Accessed[b] );
+   }
+}
+
+/*
+        Name size bucket `b' by the size it is under: <512, <4K, <1G.
+*/
+
+char *SizeBucketName( int b, char *buf )
+{
+   static const char suffix[] = " KMGT";
+   int shift = ( b == SIZE_BUCKETS - 1 ) ? b - 1 : b;
+
+   if( b == 0 )
+      return( strcpy( buf, "0" ) );
+
+   sprintf( buf, "%s%d", b == SIZE_BUCKETS - 1 ? ">=" : "<", 1 << ( shift % 10 ) );
+   if( shift >= 10 )
+      sprintf( buf + strlen( buf ), "%c", suffix[ shift / 10 ] );
+   return( buf );
+}
+
+/*
+        Print each bucket that has files in it, one per line, under the
+        directory line, as
+                  size     <4K         120 files   0.21 Megabytes
+        in the chosen sizes and units.
+*/
+
+void PrintHistogram( Scan *scan, Histogram *h )
+{
+   char name[16];
+   int b;
+
+   for( b = 0; b < SIZE_BUCKETS; b++ )
+   {
+      if( h->Size[b].Files == 0 )
+         continue;
+      printf( "          size     %-6s %10llu files ", SizeBucketName( b, name ), h->Size[b].Files );
+      PrintTotal( &h->Size[b], scan->Sizes, scan->Units, NULL );
+   }
+   for( b = 0; b < AGE_BUCKETS; b++ )
+   {
+      if( h->Modified[b].Files == 0 )
+         continue;
+      printf( "          modified %-6s %10llu files ", AgeNames[b], h->Modified[b].Files );
+      PrintTotal( &h->Modified[b], scan->Sizes, scan->Units, NULL );
+   }
+   for( b = 0; b < AGE_BUCKETS; b++ )
+   {
+      if( h->Accessed[b].Files == 0 )
+         continue;
+      printf( "          accessed %-6s %10llu files ", AgeNames[b], h->Accessed[b].Files );
+      PrintTotal( &h->Accessed[b], scan->Sizes, scan->Units, NULL );
+   }
+}
+
+/*
+        Usage by owner (/by-owner).  Files are summed by user or group id
+        in a small open addressed hash table of Totals, one per directory
+        or per thread like a histogram.  Most directories belong to one or
+        two owners, so a table starts with 8 slots and grows at half full.
+        Ids are turned into names only when printed, once each.
+*/
+
+#define OWNER_UID             1
+#define OWNER_GID             2
+
+typedef struct ownerslot{
+                         unsigned int  id;
+                         int           used;
+                         Total         total;
+                         char         *name;    /* in OwnerNames only */
+
+                    } OwnerSlot;
+
+typedef struct owners{
+                         OwnerSlot    *slot;
+                         size_t        size;    /* a power of two     */
+                         size_t        n;
+
+                    } Owners;
+
+static Owners OwnerNames;
+static int    OwnerSizes;                       /* for CompareOwners  */
+
+Owners *NewOwners( void )
+{
+   Owners *o;
+
+   if( NULL == ( o = calloc( 1, sizeof(Owners) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   return( o );
+}
+
+void FreeOwners( Owners *o )
+{
+   if( o != NULL )
+      free( o->slot );
+   free( o );
+}
+
+/*
+        Find the slot for `id', taking a free one if it is not there yet.
+*/
+
+OwnerSlot *OwnerSlotOf( Owners *o, unsigned int id )
+{
+   OwnerSlot *old = o->slot;
+   size_t oldsize = o->size, i, j;
+
+   if( 2 * ( o->n + 1 ) > o->size )
+   {
+      o->size = o->size ? o->size * 2 : 8;
+      if( NULL == ( o->slot = calloc( o->size, sizeof(OwnerSlot) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      for( j = 0; j < oldsize; j++ )
+      {
+         if( !old[j].used )
+            continue;
+         for( i = (size_t)( ( old[j].id * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( o->size - 1 ); o->slot[i].used; i = ( i + 1 ) & ( o->size - 1 ) )
+            ;
+         o->slot[i] = old[j];
+      }
+      free( old );
+   }
+
+   for( i = (size_t)( ( id * 0x9E3779B97F4A7C15ULL ) >> 32 ) & ( o->size - 1 );
+        o->slot[i].used && o->slot[i].id != id;
+        i = ( i + 1 ) & ( o->size - 1 ) )
+      ;
+
+   if( !o->slot[i].used )
+   {
+      o->slot[i].used = TRUE;
+      o->slot[i].id   = id;
+      o->n++;
+   }
+   return( &o->slot[i] );
+}
+
+void AddOwners( Owners *from, Owners *to )
+{
+   size_t i;
+
+   if( from == NULL )
+      return;
+
+   for( i = 0; i < from->size; i++ )
+      if( from->slot[i].used )
+         AddTotal( &from->slot[i].total, &OwnerSlotOf( to, from->slot[i].id )->total );
+}
+
+/*
+        The user or group name of `id', or the id itself if it has none.
+*/
+
+char *OwnerName( Scan *scan, unsigned int id )
+{
+   OwnerSlot *slot = OwnerSlotOf( &OwnerNames, id );
+   struct passwd *pw;
+   struct group *gr;
+   char buf[16];
+
+   if( slot->name == NULL )
+   {
+      if( scan->ByOwner == OWNER_UID && NULL != ( pw = getpwuid( (uid_t) id ) ) )
+         slot->name = strdup( pw->pw_name );
+      else if( scan->ByOwner == OWNER_GID && NULL != ( gr = getgrgid( (gid_t) id ) ) )
+         slot->name = strdup( gr->gr_name );
+      else
+      {
+         sprintf( buf, "%u", id );
+         slot->name = strdup( buf );
+      }
+      if( slot->name == NULL )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+   }
+   return( slot->name );
+}
+
+int CompareOwners( const void *a, const void *b )
+{
+   const OwnerSlot *x = *(OwnerSlot * const *) a, *y = *(OwnerSlot * const *) b;
+   long long sx = TotalBytes( (Total *) &x->total, OwnerSizes );
+   long long sy = TotalBytes( (Total *) &y->total, OwnerSizes );
+
+   if( sx != sy )
+      return( sx < sy ? 1 : -1 );
+   return( ( x->id > y->id ) - ( x->id < y->id ) );
+}
+
+/*
+        Print each owner, largest first, as
+                  user     alice          1200 files  12.34 Megabytes
+*/
+
+void PrintOwners( Scan *scan, Owners *o )
+{
+   OwnerSlot **sorted;
+   size_t i, n = 0;
+
+   if( o->n == 0 )
+      return;
+   if( NULL == ( sorted = malloc( o->n * sizeof(OwnerSlot *) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   for( i = 0; i < o->size; i++ )
+      if( o->slot[i].used )
+         sorted[ n++ ] = &o->slot[i];
+
+   OwnerSizes = scan->Sizes;
+   qsort( sorted, n, sizeof(OwnerSlot *), CompareOwners );
+
+   for( i = 0; i < n; i++ )
+   {
+      printf( "          %-8s %-6s %10llu files ", scan->ByOwner == OWNER_GID ? "group" : "user",
+              OwnerName( scan, sorted[i]->id ), sorted[i]->total.Files );
+      PrintTotal( &sorted[i]->total, scan->Sizes, scan->Units, NULL );
+   }
+   free( sorted );
+}
+
+/*
+        What is gathered for a directory beyond its Total: its histogram and
+        its owners, each NULL unless asked for.  The files of the directory
+        being read go into the Detail the Reader points at.  That is either
+        the directory's own, which is added into its parent's just as its
+        Total is, or, when directories are not listed with theirs, the
+        thread's one Detail for the whole tree, added up with the other
+        threads' at the end.  Nothing is shared between threads.
+*/
+
+#define DETAIL_NONE           0
+#define DETAIL_TREE           1         /* the whole tree only         */
+#define DETAIL_DIRS           2         /* and each listed directory   */
+
+typedef struct detail{
+                         Histogram *hist;       /* /histogram          */
+                         Owners    *owners;     /* /by-owner           */
+
+                    } Detail;
+
+Detail *NewDetail( Scan *scan )
+{
+   Detail *d;
+
+   if( NULL == ( d = calloc( 1, sizeof(Detail) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   if( scan->Histogram )
+      d->hist = NewHistogram();
+   if( scan->ByOwner )
+      d->owners = NewOwners();
+   return( d );
+}
+
+void ClearDetail( Detail *d )
+{
+   free( d->hist );
+   FreeOwners( d->owners );
+   d->hist   = NULL;
+   d->owners = NULL;
+}
+
+void FreeDetail( Detail *d )
+{
+   if( d != NULL )
+      ClearDetail( d );
+   free( d );
+}
+
+/*
+        Add one Detail into another, making the parts `to' lacks.  A
+        directory that could not be read has none.
+*/
+
+void AddDetail( Detail *from, Detail *to )
+{
+   if( from == NULL )
+      return;
+
+   if( from->hist != NULL )
+   {
+      if( to->hist == NULL )
+         to->hist = NewHistogram();
+      AddHistogram( from->hist, to->hist );
+   }
+   if( from->owners != NULL )
+   {
+      if( to->owners == NULL )
+         to->owners = NewOwners();
+      AddOwners( from->owners, to->owners );
+   }
+}
+
+/*
+        Print a Detail; its owners only with `owners'.
+*/
+
+void PrintDetail( Scan *scan, Detail *d, int owners )
+{
+   if( d->hist != NULL )
+      PrintHistogram( scan, d->hist );
+   if( d->owners != NULL && owners )
+      PrintOwners( scan, d->owners );
+}
+
+/*
+        Every engine hands a finished directory here: to /top, to the
+        /sort tree, or straight out.  `detail' is the directory's Detail,
+        or NULL when they are not listed per directory.  Owners are listed
+        under every directory only with /by-owner=dirs; otherwise only
+        under dirname, whose Detail is the whole tree's.
+*/
+
+void ReportTotal( Scan *scan, Total *total, Detail *detail, PathBuf *path, int level )
+{
+   if( scan->top != NULL )
+      TopAdd( scan->top, total, path, level, scan->Sizes );
+   else if( scan->results != NULL )
+      ResultAdd( scan->results, total, path, scan->PathDelimiter );
+   else
+   {
+      PrintLine( scan, total, path->buf, level );
+      if( detail != NULL )
+         PrintDetail( scan, detail, scan->OwnerDirs || level == 1 );
+   }
+}
+
+/*
+        Name patterns (/exclude, /include).  All the patterns of one option
+        are compiled once into a single matcher.  Patterns with no wildcard
+        are kept in a hash table and found with one lookup.  The rest are
+        laid end to end as one automaton, one state per pattern position,
+        and every pattern is run at once over a name by keeping the live
+        states as a bit set: each character moves the states whose position
+        matches it one bit on, and a `*' state also stays where it is.
+
+        A pattern matches a whole file or directory name, never a path.
+        `*' matches any run of characters, leading dots included, `?' any
+        one, [abc], [a-z] and [!abc] one from a set, and \ quotes the next
+        character.
+*/
+
+#define MATCH_STATES          4096      /* wildcard positions, in all  */
+#define MATCH_WORDS           ( MATCH_STATES / 64 )
+
+typedef struct matcher{
+                         char              **literal;   /* hash table     */
+                         size_t              literalsize;
+                         size_t              literals;
+                         char              **glob;      /* wildcard ones  */
+                         size_t              globs;
+                         size_t              globsize;
+                         int                 states;
+                         int                 words;
+                         unsigned long long *match;     /* [256][words]   */
+                         unsigned long long  star[ MATCH_WORDS ];
+                         unsigned long long  start[ MATCH_WORDS ];
+                         unsigned long long  accept[ MATCH_WORDS ];
+
+                    } Matcher;
+
+/*
+        Read the glob token at *p into `set', the characters it matches, or
+        set `star' for a `*'.  Returns FALSE at the end of the glob.
+*/
+
+int GlobToken( char **p, int *star, unsigned char set[32] )
+{
+   char *s = *p, *q;
+   int c, lo, hi, negate, first;
+
+   if( *s == 0 )
+      return( FALSE );
+
+   *star = FALSE;
+   memset( set, 0, 32 );
+
+   if( *s == '*' )
+   {
+      *star = TRUE;
+      *p = s + 1;
+      return( TRUE );
+   }
+
+   if( *s == '?' )
+   {
+      memset( set, 0xFF, 32 );
+      *p = s + 1;
+      return( TRUE );
+   }
+
+          /* A `[' with no closing `]' is an ordinary character. */
+
+   q = s + 1;
+   if( *q == '!' || *q == '^' )
+      q++;
+   if( *q == ']' )
+      q++;
+   if( *s == '[' && strchr( q, ']' ) != NULL )
+   {
+      s++;
+      if( ( negate = ( *s == '!' || *s == '^' ) ) )
+         s++;
+      for( first = TRUE; *s != 0 && ( *s != ']' || first ); first = FALSE )
+      {
+         lo = hi = (unsigned char) *s++;
+         if( s[0] == '-' && s[1] != 0 && s[1] != ']' )
+         {
+            hi = (unsigned char) s[1];
+            s += 2;
+         }
+         for( c = lo; c <= hi; c++ )
+            set[ c / 8 ] |= (unsigned char)( 1 << ( c % 8 ) );
+      }
+      if( *s == ']' )
+         s++;
+      if( negate )
+         for( c = 0; c < 32; c++ )
+            set[c] = (unsigned char) ~set[c];
+      *p = s;
+      return( TRUE );
+   }
+
+   if( *s == '\\' && s[1] != 0 )
+      s++;
+   c = (unsigned char) *s;
+   set[ c / 8 ] |= (unsigned char)( 1 << ( c % 8 ) );
+   *p = s + 1;
+   return( TRUE );
+}
+
+void MatcherInsert( char **table, size_t size, char *name )
+{
+   size_t i;
+
+   for( i = NameHash( name, strlen( name ) ) & ( size - 1 ); table[i] != NULL; i = ( i + 1 ) & ( size - 1 ) )
+      ;
+   table[i] = name;
+}
+
+/*
+        Add one pattern.  Nothing is compiled until MatcherCompile.
+*/
+
+void MatcherAdd( Matcher *m, char *pattern )
+{
+   char **table;
+   size_t i, newsize;
+
+   if( strpbrk( pattern, "*?[\\" ) != NULL )
+   {
+      Reserve( (char **) &m->glob, &m->globsize, ( m->globs + 1 ) * sizeof(char *) );
+      m->glob[ m->globs++ ] = pattern;
+      return;
+   }
+
+   if( 2 * ( m->literals + 1 ) > m->literalsize )
+   {
+      newsize = m->literalsize ? m->literalsize * 2 : 64;
+      if( NULL == ( table = calloc( newsize, sizeof(char *) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      for( i = 0; i < m->literalsize; i++ )
+         if( m->literal[i] != NULL )
+            MatcherInsert( table, newsize, m->literal[i] );
+      free( m->literal );
+      m->literal     = table;
+      m->literalsize = newsize;
+   }
+   MatcherInsert( m->literal, m->literalsize, pattern );
+   m->literals++;
+}
+
+/*
+        Lay the wildcard patterns out as one automaton.  Pattern p takes
+        one state per token and one more, after them, to accept in.
+*/
+
+void MatcherCompile( Matcher *m )
+{
+   unsigned char set[32];
+   size_t g;
+   char *p;
+   int star, state = 0, c;
+
+   for( g = 0; g < m->globs; g++ )
+   {
+      for( p = m->glob[g]; GlobToken( &p, &star, set ); )
+         state++;
+      state++;
+   }
+
+   if( state > MATCH_STATES )
+   {
+      fprintf(stderr,"edu: Too many wildcard patterns.\n");
+      exit(1);
+   }
+
+   m->states = state;
+   m->words  = ( state + 63 ) / 64;
+   if( m->words == 0 )
+      return;
+
+   if( NULL == ( m->match = calloc( 256 * (size_t) m->words, sizeof(unsigned long long) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+
+   for( g = 0, state = 0; g < m->globs; g++ )
+   {
+      m->start[ state / 64 ] |= 1ULL << ( state % 64 );
+      for( p = m->glob[g]; GlobToken( &p, &star, set ); state++ )
+      {
+         if( star )
+            m->star[ state / 64 ] |= 1ULL << ( state % 64 );
+         else
+            for( c = 0; c < 256; c++ )
+               if( set[ c / 8 ] & ( 1 << ( c % 8 ) ) )
+                  m->match[ c * m->words + state / 64 ] |= 1ULL << ( state % 64 );
+      }
+      m->accept[ state / 64 ] |= 1ULL << ( state % 64 );
+      state++;
+   }
+}
+
+/*
+        A `*' state may match nothing, so the state after it is live too.
+*/
+
+void MatcherClose( Matcher *m, unsigned long long *d )
+{
+   unsigned long long carry, t, more;
+   int w;
+
+   do
+   {
+      more = 0;
+      for( w = 0, carry = 0; w < m->words; w++ )
+      {
+         t      = d[w] & m->star[w];
+         t      = ( t << 1 ) | carry;
+         carry  = ( d[w] & m->star[w] ) >> 63;
+         more  |= t & ~d[w];
+         d[w]  |= t;
+      }
+   } while( more != 0 );
+}
+
+int MatcherTest( Matcher *m, char *name )
+{
+   unsigned long long d[ MATCH_WORDS ], t, carry, live;
+   unsigned long long *match;
+   size_t i;
+   int w;
+
+   if( m->literals > 0 )
+   {
+      for( i = NameHash( name, strlen( name ) ) & ( m->literalsize - 1 ); m->literal[i] != NULL; i = ( i + 1 ) & ( m->literalsize - 1 ) )
+         if( 0 == strcmp( m->literal[i], name ) )
+            return( TRUE );
+   }
+
+   if( m->words == 0 )
+      return( FALSE );
+
+   memcpy( d, m->start, m->words * sizeof(unsigned long long) );
+   MatcherClose( m, d );
+
+   for( ; *name != 0; name++ )
+   {
+      match = m->match + (unsigned char) *name * m->words;
+      live  = 0;
+      for( w = 0, carry = 0; w < m->words; w++ )
+      {
+         t     = d[w] & match[w];
+         d[w]  = ( t << 1 ) | carry | ( d[w] & m->star[w] );
+         carry = t >> 63;
+         live |= d[w];
+      }
+      if( live == 0 )
+         return( FALSE );
+      MatcherClose( m, d );
+   }
+
+   for( w = 0; w < m->words; w++ )
+      if( d[w] & m->accept[w] )
+         return( TRUE );
+   return( FALSE );
+}
+
+/*
+        Free what MatcherAdd and MatcherCompile made.  The patterns are the
+        caller's, and stay.
+*/
+
+void MatcherFree( Matcher *m )
+{
+   free( m->literal );
+   free( m->glob );
+   free( m->match );
+   memset( m, 0, sizeof(*m) );
+}
+
+/*
+        Should the entry `name' be left out?  Excluded names are, and with
+        /include so are files that match no include pattern.  Directories
+        are only subject to /exclude, so /include can pick files anywhere
+        in the tree.
+*/
+
+int Excluded( Scan *scan, char *name, int isdir )
+{
+   if( scan->exclude != NULL && MatcherTest( scan->exclude, name ) )
+      return( TRUE );
+   return( !isdir && scan->include != NULL && !MatcherTest( scan->include, name ) );
+}
+
+/*
+        Directory reading.  On Linux whole batches of entries are read with
+        getdents64 into a buffer that is kept and reused for every directory
+        a thread reads.  Elsewhere readdir is used.  Either way the entry
+        type from the directory itself decides what to do with an entry, so
+        directories and links are never stat'ed; only entries of unknown type
+        get a full stat, and files get the cheapest stat the system offers.
+*/
+
+#ifndef DT_UNKNOWN
+#define DT_UNKNOWN            0
+#define DT_DIR                4
+#define DT_LNK               10
+#endif
+
+#define READ_BATCH            65536     /* getdents64 buffer size      */
+#define INODE_WINDOW          8192      /* entries sorted at a time    */
+
+/*
+        With /inode-order, entries are held back in a window and handed on
+        in inode number order rather than in the order the directory gives
+        them.  On ext4 and XFS that order follows the inode tables on disk,
+        so the stat calls read them front to back instead of seeking about,
+        and subdirectories are then gone into in the same order.  The
+        window is one directory, or INODE_WINDOW entries of a larger one.
+*/
+
+typedef struct inodeentry{
+                         unsigned long long  ino;
+                         size_t              name;      /* offset in names */
+                         int                 type;
+
+                    } InodeEntry;
+
+#ifdef __linux__
+struct linux_dirent64{
+                         unsigned long long d_ino;
+                         long long          d_off;
+                         unsigned short     d_reclen;
+                         unsigned char      d_type;
+                         char               d_name[1];
+                     };
+#endif
+
+/*
+        Scan instrumentation (/stats).  Each thread counts and times the
+        filesystem calls it makes in its own Reader, so nothing is shared
+        while scanning, and the Readers are added together at the end.  A
+        call's time goes into a histogram with one bucket per power of two
+        nanoseconds.  The slowest directories, by the time taken to open and
+        read them, are kept with their paths.  Without /stats the clock is
+        never read.
+*/
+
+#define CALL_OPEN             0
+#define CALL_READ             1         /* one getdents64 batch        */
+#define CALL_STAT             2
+#define CALL_CLOSE            3
+#define CALL_OUTPUT           4         /* printing one directory      */
+#define CALLS                 5
+
+#define LATENCY_BUCKETS       40        /* 1ns up to 9 minutes         */
+#define SLOWEST               10
+
+typedef struct slowdir{
+                         unsigned long long nanos;        /* 0 = free slot    */
+                         char              *path;
+
+                    } SlowDir;
+
+typedef struct reader{
+                         char              *buf;          /* getdents64 batch */
+                         size_t             size;
+                         unsigned long long Entries;
+                         unsigned long long Stats;
+                         unsigned long long StatsAvoided;
+                         unsigned long long CacheHits;
+                         unsigned long long CacheMisses;
+                         unsigned long long LinksSkipped;
+                         unsigned long long Directories;
+                         unsigned long long Calls[ CALLS ];
+                         unsigned long long Nanos[ CALLS ];
+                         unsigned long long Latency[ CALLS ][ LATENCY_BUCKETS ];
+                         SlowDir            Slowest[ SLOWEST ];
+                         InodeEntry        *window;       /* /inode-order     */
+                         size_t             windowsize;
+                         size_t             windowlen;
+                         char              *names;
+                         size_t             namessize;
+                         size_t             nameslen;
+                         struct uring      *ring;         /* /uring           */
+                         int                ringfailed;
+                         unsigned long long UringStats;
+                         Detail            *dir;          /* files go here    */
+                         Detail             tree;         /* or all in here   */
+                         struct dups       *dups;         /* /duplicates      */
+                         struct linklist   *deferred;     /* links, /threads  */
+
+                    } Reader;
+
+unsigned long long Now( void )
+{
+   struct timespec ts;
+
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return( (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec );
+}
+
+unsigned long long StartCall( Scan *scan )
+{
+   return( scan->ShowStats ? Now() : 0 );
+}
+
+void EndCall( Scan *scan, Reader *r, int call, unsigned long long start )
+{
+   unsigned long long ns;
+   int b;
+
+   if( !scan->ShowStats )
+      return;
+
+   ns = Now() - start;
+   b  = 63 - __builtin_clzll( ns | 1 );
+   if( b >= LATENCY_BUCKETS )
+      b = LATENCY_BUCKETS - 1;
+
+   r->Calls[ call ]++;
+   r->Nanos[ call ] += ns;
+   r->Latency[ call ][ b ]++;
+}
+
+/*
+        Return the slot a directory that took `nanos' should go in, or NULL
+        if it is not among the slowest so far.
+*/
+
+SlowDir *SlowSlot( Reader *r, unsigned long long nanos )
+{
+   SlowDir *min = &r->Slowest[0];
+   int i;
+
+   for( i = 1; i < SLOWEST; i++ )
+      if( r->Slowest[i].nanos < min->nanos )
+         min = &r->Slowest[i];
+
+   return( nanos > min->nanos ? min : NULL );
+}
+
+void SlowSet( SlowDir *slot, unsigned long long nanos, char *path )
+{
+   free( slot->path );
+   slot->nanos = nanos;
+   if( NULL == ( slot->path = strdup( path ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+}
+
+/*
+        Subdirectory names of one directory, packed one after another with
+        their terminating NULs, in readdir order.
+*/
+
+typedef struct namelist{
+                         char   *buf;
+                         size_t  size;
+                         size_t  len;
+
+                    } NameList;
+
+void NameAdd( NameList *list, char *name )
+{
+   size_t l = strlen( name ) + 1;
+
+   Reserve( &list->buf, &list->size, list->len + l );
+   memcpy( list->buf + list->len, name, l );
+   list->len += l;
+}
+
+unsigned long long DevInoHash( unsigned long long dev, unsigned long long ino )
+{
+   unsigned long long h = ino * 0x9E3779B97F4A7C15ULL ^ dev;
+
+   h ^= h >> 29;
+   h *= 0xBF58476D1CE4E5B9ULL;
+   h ^= h >> 32;
+   return( h );
+}
+
+/*
+        Hard links (/dedupe-links).
+
+        A file with more than one link is counted the first time any of its
+        names is seen, and the set remembers it by device and inode.  Files
+        with a single link never touch the set.  The set is split into
+        shards, each an open addressing table with its own lock, so threads
+        adding different inodes seldom wait on each other.  An entry is two
+        64 bit words; inode 0 marks an empty slot.
+*/
+
+#define LINK_SHARDS           64
+
+typedef struct linkkey{
+                         unsigned long long dev;
+                         unsigned long long ino;
+
+                    } LinkKey;
+
+typedef struct linkshard{
+                         pthread_mutex_t    lock;
+                         LinkKey           *slot;
+                         size_t             size;      /* a power of two */
+                         size_t             used;
+
+                    } LinkShard;
+
+typedef struct linkset{
+                         LinkShard          shard[ LINK_SHARDS ];
+
+                    } LinkSet;
+
+void LinkSetInit( LinkSet *set )
+{
+   int i;
+
+   memset( set, 0, sizeof(LinkSet) );
+   for( i = 0; i < LINK_SHARDS; i++ )
+      pthread_mutex_init( &set->shard[i].lock, NULL );
+}
+
+void LinkSetFree( LinkSet *set )
+{
+   int i;
+
+   for( i = 0; i < LINK_SHARDS; i++ )
+   {
+      free( set->shard[i].slot );
+      pthread_mutex_destroy( &set->shard[i].lock );
+   }
+}
+
+void LinkInsert( LinkKey *slot, size_t size, unsigned long long hash, LinkKey *key )
+{
+   size_t i;
+
+   for( i = ( hash / LINK_SHARDS ) & ( size - 1 ); slot[i].ino != 0; i = ( i + 1 ) & ( size - 1 ) )
+      ;
+   slot[i] = *key;
+}
+
+/*
+        Return TRUE if the inode has been counted already, otherwise add it
+        and return FALSE.
+*/
+
+int LinkSeen( LinkSet *set, unsigned long long dev, unsigned long long ino )
+{
+   unsigned long long hash = DevInoHash( dev, ino );
+   LinkShard *sh = &set->shard[ hash % LINK_SHARDS ];
+   LinkKey key;
+   size_t i;
+   int seen = FALSE;
+
+   key.dev = dev;
+   key.ino = ino;
+
+   pthread_mutex_lock( &sh->lock );
+
+   for( i = ( hash / LINK_SHARDS ) & ( sh->size - 1 ); sh->size > 0 && sh->slot[i].ino != 0; i = ( i + 1 ) & ( sh->size - 1 ) )
+   {
+      if( sh->slot[i].ino == ino && sh->slot[i].dev == dev )
+      {
+         seen = TRUE;
+         break;
+      }
+   }
+
+   if( !seen )
+   {
+          /* Keep each shard at most 3/4 full. */
+
+      if( 4 * ( sh->used + 1 ) > 3 * sh->size )
+      {
+         size_t newsize = sh->size ? sh->size * 2 : 256;
+         LinkKey *slot = calloc( newsize, sizeof(LinkKey) );
+
+         if( slot == NULL )
+         {
+            fprintf(stderr,"edu: Out of memory.\n");
+            exit(1);
+         }
+         for( i = 0; i < sh->size; i++ )
+            if( sh->slot[i].ino != 0 )
+               LinkInsert( slot, newsize, DevInoHash( sh->slot[i].dev, sh->slot[i].ino ), &sh->slot[i] );
+         free( sh->slot );
+         sh->slot = slot;
+         sh->size = newsize;
+      }
+      LinkInsert( sh->slot, sh->size, hash, &key );
+      sh->used++;
+   }
+
+   pthread_mutex_unlock( &sh->lock );
+
+   return( seen );
+}
+
+/*
+        What the engines need to know about a non-directory entry.
+*/
+
+typedef struct fileinfo{
+                         long long          size;
+                         long long          blocks;    /* 512 byte units */
+                         unsigned long long dev;
+                         unsigned long long ino;
+                         unsigned long long nlink;
+                         long long          mtime;     /* /histogram     */
+                         long long          atime;
+                         unsigned int       uid;       /* /by-owner      */
+                         unsigned int       gid;
+
+                    } FileInfo;
+
+/*
+        What statx is asked for: size alone, plus link count and inode when
+        links are being deduplicated or files compared by /duplicates,
+        times for /histogram and the owner for /by-owner.
+*/
+
+#ifdef STATX_SIZE
+unsigned int StatxMask( Scan *scan )
+{
+   unsigned int mask = STATX_SIZE | STATX_BLOCKS;
+
+   if( scan->links != NULL )
+      mask |= STATX_NLINK | STATX_INO;
+   if( scan->Duplicates )
+      mask |= STATX_INO | STATX_NLINK;
+   if( scan->Histogram )
+      mask |= STATX_MTIME | STATX_ATIME;
+   if( scan->ByOwner )
+      mask |= STATX_UID | STATX_GID;
+   return( mask );
+}
+#endif
+
+/*
+        Stat a non-directory entry, asking for no more than is needed.
+        Returns -1 if it could not be stat'ed.
+*/
+
+int StatFile( Scan *scan, Reader *r, int fd, char *name, FileInfo *fi )
+{
+   unsigned long long start;
+   int status;
+#ifdef STATX_SIZE
+   struct statx sx;
+   unsigned int mask = StatxMask( scan );
+
+   r->Stats++;
+   start  = StartCall( scan );
+   status = statx( fd, name, AT_SYMLINK_NOFOLLOW, mask, &sx );
+   EndCall( scan, r, CALL_STAT, start );
+   if( status == -1 )
+      return( -1 );
+
+   fi->size   = (long long) sx.stx_size;
+   fi->blocks = (long long) sx.stx_blocks;
+   fi->dev   = makedev( sx.stx_dev_major, sx.stx_dev_minor );
+   fi->ino   = sx.stx_ino;
+   fi->nlink = ( sx.stx_mask & STATX_NLINK ) ? sx.stx_nlink : 1;
+   fi->mtime = sx.stx_mtime.tv_sec;
+   fi->atime = sx.stx_atime.tv_sec;
+   fi->uid   = sx.stx_uid;
+   fi->gid   = sx.stx_gid;
+#else
+   struct stat statbuf;
+
+   r->Stats++;
+   start  = StartCall( scan );
+   status = fstatat( fd, name, &statbuf, AT_SYMLINK_NOFOLLOW );
+   EndCall( scan, r, CALL_STAT, start );
+   if( status == -1 )
+      return( -1 );
+
+   fi->size   = (long long) statbuf.st_size;
+   fi->blocks = (long long) statbuf.st_blocks;
+   fi->dev    = statbuf.st_dev;
+   fi->ino   = statbuf.st_ino;
+   fi->nlink = statbuf.st_nlink;
+   fi->mtime = statbuf.st_mtime;
+   fi->atime = statbuf.st_atime;
+   fi->uid   = statbuf.st_uid;
+   fi->gid   = statbuf.st_gid;
+#endif
+   return( 0 );
+}
+
+/*
+        Duplicate files (/duplicates).  While the tree is scanned, every
+        file with any bytes in it is noted with its size, device, inode and
+        name.  Each Reader keeps its own list, the path of each directory
+        stored once with its files pointing at it, and the lists are put
+        together after the scan for FindDuplicates to compare.
+*/
+
+typedef struct dupfile{
+                         unsigned long long  size;
+                         unsigned long long  dev;
+                         unsigned long long  ino;
+                         size_t              dir;       /* offsets in names   */
+                         size_t              name;
+                         unsigned long long  head;      /* first and last 4K  */
+                         unsigned long long  hash;      /* the whole file     */
+                         size_t              same;      /* its bytes' first   */
+                         int                 failed;    /* could not be read  */
+
+                    } DupFile;
+
+typedef struct dups{
+                         DupFile            *file;
+                         size_t              n;
+                         size_t              size;
+                         NameList            names;
+                         size_t              dir;       /* being read now     */
+
+                    } Dups;
+
+/*
+        Note the path of the directory whose files come next.
+*/
+
+void DupDir( Reader *r, char *path )
+{
+   if( r->dups == NULL && NULL == ( r->dups = calloc( 1, sizeof(Dups) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   r->dups->dir = r->dups->names.len;
+   NameAdd( &r->dups->names, path );
+}
+
+void DupAdd( Dups *d, FileInfo *fi, char *name )
+{
+   DupFile *f;
+
+   Reserve( (char **) &d->file, &d->size, ( d->n + 1 ) * sizeof(DupFile) );
+   f = &d->file[ d->n++ ];
+   memset( f, 0, sizeof(DupFile) );
+   f->size = (unsigned long long) fi->size;
+   f->dev  = fi->dev;
+   f->ino  = fi->ino;
+   f->dir  = d->dir;
+   f->name = d->names.len;
+   NameAdd( &d->names, name );
+}
+
+/*
+        Move one thread's list onto the end of another's.
+*/
+
+void AddDups( Reader *to, Reader *from )
+{
+   Dups *a = to->dups, *b = from->dups;
+   size_t i;
+
+   from->dups = NULL;
+   if( b == NULL )
+      return;
+   if( a == NULL )
+   {
+      to->dups = b;
+      return;
+   }
+
+   Reserve( (char **) &a->file, &a->size, ( a->n + b->n ) * sizeof(DupFile) );
+   for( i = 0; i < b->n; i++ )
+   {
+      a->file[ a->n + i ]       = b->file[i];
+      a->file[ a->n + i ].dir  += a->names.len;
+      a->file[ a->n + i ].name += a->names.len;
+   }
+   a->n += b->n;
+
+   Reserve( &a->names.buf, &a->names.size, a->names.len + b->names.len );
+   memcpy( a->names.buf + a->names.len, b->names.buf, b->names.len );
+   a->names.len += b->names.len;
+
+   free( b->file );
+   free( b->names.buf );
+   free( b );
+}
+
+/*
+        Files with several links, held back by the parallel engine with
+        /dedupe-links until it can settle them in the serial engine's
+        order (see SettleLinks).
+*/
+
+typedef struct linklist{
+                         FileInfo           *fi;
+                         size_t              n;
+                         size_t              size;
+
+                    } LinkList;
+
+/*
+        Add a file into a Detail's histogram and owners, making those the
+        scan asks for when the Detail has none yet.
+*/
+
+void DetailFile( Scan *scan, Detail *d, FileInfo *fi )
+{
+   Total file;
+
+   file.Bytes     = (Counter) fi->size;
+   file.Allocated = (Counter) fi->blocks * 512;
+   file.Files     = 1;
+   if( scan->Histogram && d->hist == NULL )
+      d->hist = NewHistogram();
+   if( scan->ByOwner && d->owners == NULL )
+      d->owners = NewOwners();
+   if( d->hist != NULL )
+      HistogramAdd( d->hist, &file, scan->Now - fi->mtime, scan->Now - fi->atime );
+   if( d->owners != NULL )
+      AddTotal( &file, &OwnerSlotOf( d->owners, scan->ByOwner == OWNER_GID ? fi->gid : fi->uid )->total );
+}
+
+/*
+        Add a file into `total', and into the Reader's Detail if there is
+        one, unless it is another link to an inode that has been counted
+        already.  With /duplicates it is noted as well.  A Reader that
+        defers links keeps every file with more than one for later.
+*/
+
+void CountFile( Scan *scan, Reader *r, FileInfo *fi, char *name, Total *total )
+{
+   LinkList *l = r->deferred;
+
+   if( fi->nlink > 1 && l != NULL )
+   {
+      Reserve( (char **) &l->fi, &l->size, ( l->n + 1 ) * sizeof(FileInfo) );
+      l->fi[ l->n++ ] = *fi;
+      if( r->dups != NULL && fi->size > 0 )
+         DupAdd( r->dups, fi, name );
+      return;
+   }
+
+   if( fi->nlink > 1 && scan->links != NULL && LinkSeen( scan->links, fi->dev, fi->ino ) )
+   {
+      r->LinksSkipped++;
+      return;
+   }
+
+   total->Files++;
+   total->Bytes     += (Counter) fi->size;
+   total->Allocated += (Counter) fi->blocks * 512;
+
+   if( r->dups != NULL && fi->size > 0 )
+      DupAdd( r->dups, fi, name );
+
+   if( r->dir != NULL )
+      DetailFile( scan, r->dir, fi );
+}
+
+/*
+        Point the Reader at where the files of the directory about to be
+        read go, and return the directory's own Detail if it keeps one.
+*/
+
+Detail *DirDetail( Scan *scan, Reader *r )
+{
+   if( scan->Details == DETAIL_DIRS )
+      return( r->dir = NewDetail( scan ) );
+
+   if( scan->Details == DETAIL_TREE )
+   {
+      if( scan->Histogram && r->tree.hist == NULL )
+         r->tree.hist = NewHistogram();
+      if( scan->ByOwner && r->tree.owners == NULL )
+         r->tree.owners = NewOwners();
+      r->dir = &r->tree;
+   }
+   return( NULL );
+}
+
+#define URING_DEPTH           64        /* default stats in flight     */
+
+#ifdef HAVE_URING
+
+/*
+        Asynchronous stat (/uring, Linux).  Each thread has its own io_uring
+        and queues an IORING_OP_STATX for every file of the directory it is
+        reading instead of waiting on each stat in turn.  Requests are
+        submitted half a ring at a time while the directory is still being
+        read, and are completed in whatever order the kernel finishes them,
+        straight into the directory's total; the directory is not done
+        until all of them are in.  On a network filesystem this keeps up to
+        /uring=N round trips going at once per thread.
+
+        The ring is set up with the raw system calls, as getdents64 is used.
+        If the kernel has no io_uring, or no IORING_OP_STATX, the thread
+        goes back to stat'ing one file at a time.
+*/
+
+typedef struct uringslot{
+                         struct statx        sx;
+                         char                name[ 256 ];    /* NAME_MAX + 1 */
+                         int                 next;           /* free list    */
+
+                    } UringSlot;
+
+typedef struct uring{
+                         int                  fd;
+                         unsigned int        *sqhead;
+                         unsigned int        *sqtail;
+                         unsigned int        *sqmask;
+                         unsigned int        *sqarray;
+                         unsigned int        *cqhead;
+                         unsigned int        *cqtail;
+                         unsigned int        *cqmask;
+                         struct io_uring_sqe *sqes;
+                         struct io_uring_cqe *cqes;
+                         void                *sqring;
+                         void                *cqring;
+                         size_t               sqringsize;
+                         size_t               cqringsize;
+                         size_t               sqessize;
+                         UringSlot           *slot;
+                         int                  free;          /* or -1        */
+                         unsigned int         depth;
+                         unsigned int         pending;       /* unsubmitted  */
+                         unsigned int         inflight;      /* not yet in   */
+
+                    } Uring;
+
+void UringClose( Uring *ring )
+{
+   if( ring == NULL )
+      return;
+   if( ring->sqes != NULL && ring->sqes != MAP_FAILED )
+      munmap( ring->sqes, ring->sqessize );
+   if( ring->cqring != NULL && ring->cqring != MAP_FAILED && ring->cqring != ring->sqring )
+      munmap( ring->cqring, ring->cqringsize );
+   if( ring->sqring != NULL && ring->sqring != MAP_FAILED )
+      munmap( ring->sqring, ring->sqringsize );
+   if( ring->fd != -1 )
+      close( ring->fd );
+   free( ring->slot );
+   free( ring );
+}
+
+/*
+        Set up this thread's ring.  Returns NULL, and remembers not to try
+        again, if the kernel will not have it.
+*/
+
+Uring *UringOpen( Scan *scan, Reader *r )
+{
+   struct io_uring_params p;
+   Uring *ring;
+   unsigned int i;
+
+   if( NULL == ( ring = calloc( 1, sizeof(Uring) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+
+   memset( &p, 0, sizeof(p) );
+   if( -1 == ( ring->fd = (int) syscall( __NR_io_uring_setup, scan->UringDepth, &p ) ) )
+   {
+      UringClose( ring );
+      r->ringfailed = TRUE;
+      return( NULL );
+   }
+
+   ring->sqringsize = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+   ring->cqringsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+   if( p.features & IORING_FEAT_SINGLE_MMAP )
+   {
+      if( ring->cqringsize > ring->sqringsize )
+         ring->sqringsize = ring->cqringsize;
+      ring->cqringsize = ring->sqringsize;
+   }
+
+   ring->sqring = mmap( NULL, ring->sqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING );
+   if( p.features & IORING_FEAT_SINGLE_MMAP )
+      ring->cqring = ring->sqring;
+   else
+      ring->cqring = mmap( NULL, ring->cqringsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           ring->fd, IORING_OFF_CQ_RING );
+   ring->sqessize = p.sq_entries * sizeof(struct io_uring_sqe);
+   ring->sqes     = mmap( NULL, ring->sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQES );
+
+   if( ring->sqring == MAP_FAILED || ring->cqring == MAP_FAILED || ring->sqes == MAP_FAILED ||
+       NULL == ( ring->slot = calloc( p.sq_entries, sizeof(UringSlot) ) ) )
+   {
+      UringClose( ring );
+      r->ringfailed = TRUE;
+      return( NULL );
+   }
+
+   ring->sqhead  = (unsigned int *)( (char *) ring->sqring + p.sq_off.head );
+   ring->sqtail  = (unsigned int *)( (char *) ring->sqring + p.sq_off.tail );
+   ring->sqmask  = (unsigned int *)( (char *) ring->sqring + p.sq_off.ring_mask );
+   ring->sqarray = (unsigned int *)( (char *) ring->sqring + p.sq_off.array );
+   ring->cqhead  = (unsigned int *)( (char *) ring->cqring + p.cq_off.head );
+   ring->cqtail  = (unsigned int *)( (char *) ring->cqring + p.cq_off.tail );
+   ring->cqmask  = (unsigned int *)( (char *) ring->cqring + p.cq_off.ring_mask );
+   ring->cqes    = (struct io_uring_cqe *)( (char *) ring->cqring + p.cq_off.cqes );
+
+          /* No more in flight than the submission ring holds, so the
+             completion ring, twice its size, cannot overflow. */
+
+   ring->depth = p.sq_entries;
+   for( i = 0; i < ring->depth; i++ )
+      ring->slot[i].next = ( i + 1 < ring->depth ) ? (int)( i + 1 ) : -1;
+   ring->free = 0;
+
+   return( ring );
+}
+
+/*
+        Submit what is queued and, with `wait', block until at least one
+        request is done.
+*/
+
+void UringEnter( Scan *scan, Reader *r, Uring *ring, int wait )
+{
+   unsigned long long start;
+   long n;
+
+   start = StartCall( scan );
+   for(;;)
+   {
+      n = syscall( __NR_io_uring_enter, ring->fd, ring->pending, wait ? 1 : 0,
+                   wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0 );
+      if( n >= 0 || ( errno != EINTR && errno != EAGAIN && errno != EBUSY ) )
+         break;
+   }
+   EndCall( scan, r, CALL_STAT, start );
+
+   if( n < 0 )
+   {
+      perror( "edu: io_uring_enter" );
+      exit(1);
+   }
+   ring->pending -= (unsigned int) n;
+}
+
+void FileFromStatx( struct statx *sx, FileInfo *fi )
+{
+   fi->size   = (long long) sx->stx_size;
+   fi->blocks = (long long) sx->stx_blocks;
+   fi->dev    = makedev( sx->stx_dev_major, sx->stx_dev_minor );
+   fi->ino    = sx->stx_ino;
+   fi->nlink  = ( sx->stx_mask & STATX_NLINK ) ? sx->stx_nlink : 1;
+   fi->mtime  = sx->stx_mtime.tv_sec;
+   fi->atime  = sx->stx_atime.tv_sec;
+   fi->uid    = sx->stx_uid;
+   fi->gid    = sx->stx_gid;
+}
+
+/*
+        Take in every finished request, in the order the kernel finished
+        them.  A kernel without IORING_OP_STATX fails it with EINVAL: the
+        file is stat'ed the old way, and so is everything after it.
+*/
+
+void UringReap( Scan *scan, Reader *r, Uring *ring, int fd, Total *total )
+{
+   struct io_uring_cqe *cqe;
+   unsigned int head, tail;
+   UringSlot *slot;
+   FileInfo fi;
+   int i;
+
+   head = *ring->cqhead;
+   tail = __atomic_load_n( ring->cqtail, __ATOMIC_ACQUIRE );
+
+   for( ; head != tail; head++ )
+   {
+      cqe  = &ring->cqes[ head & *ring->cqmask ];
+      i    = (int) cqe->user_data;
+      slot = &ring->slot[i];
+
+      if( cqe->res == 0 )
+      {
+         FileFromStatx( &slot->sx, &fi );
+         CountFile( scan, r, &fi, slot->name, total );
+      }
+      else if( cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP )
+      {
+         r->ringfailed = TRUE;
+         r->Stats--;
+         r->UringStats--;
+         if( StatFile( scan, r, fd, slot->name, &fi ) == 0 )
+            CountFile( scan, r, &fi, slot->name, total );
+      }
+
+      slot->next = ring->free;
+      ring->free = i;
+      ring->inflight--;
+   }
+
+   __atomic_store_n( ring->cqhead, head, __ATOMIC_RELEASE );
+}
+
+/*
+        Queue a stat of `name' in directory `fd'.  Returns FALSE if there is
+        no ring and the caller must stat it itself.
+*/
+
+int UringStat( Scan *scan, Reader *r, int fd, char *name, Total *total )
+{
+   struct io_uring_sqe *sqe;
+   Uring *ring = r->ring;
+   unsigned int tail, mask = StatxMask( scan );
+   size_t len = strlen( name );
+   int i;
+
+   if( r->ringfailed || len >= sizeof(ring->slot[0].name) )
+      return( FALSE );
+   if( ring == NULL && NULL == ( ring = r->ring = UringOpen( scan, r ) ) )
+      return( FALSE );
+
+   while( ring->free == -1 )
+   {
+      UringEnter( scan, r, ring, TRUE );
+      UringReap( scan, r, ring, fd, total );
+   }
+
+   i          = ring->free;
+   ring->free = ring->slot[i].next;
+   memcpy( ring->slot[i].name, name, len + 1 );
+
+   tail = *ring->sqtail;
+   sqe  = &ring->sqes[ tail & *ring->sqmask ];
+   memset( sqe, 0, sizeof(*sqe) );
+   sqe->opcode      = IORING_OP_STATX;
+   sqe->fd          = fd;
+   sqe->addr        = (unsigned long long)(unsigned long) ring->slot[i].name;
+   sqe->len         = mask;
+   sqe->off         = (unsigned long long)(unsigned long) &ring->slot[i].sx;
+   sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+   sqe->user_data   = (unsigned long long) i;
+   ring->sqarray[ tail & *ring->sqmask ] = tail & *ring->sqmask;
+   __atomic_store_n( ring->sqtail, tail + 1, __ATOMIC_RELEASE );
+
+   ring->pending++;
+   ring->inflight++;
+   r->Stats++;
+   r->UringStats++;
+
+   if( ring->pending >= ring->depth / 2 )
+      UringEnter( scan, r, ring, FALSE );
+   UringReap( scan, r, ring, fd, total );
+   return( TRUE );
+}
+
+/*
+        Wait for everything still out for the directory `fd'.
+*/
+
+void UringDrain( Scan *scan, Reader *r, int fd, Total *total )
+{
+   Uring *ring = r->ring;
+
+   while( ring != NULL && ring->inflight > 0 )
+   {
+      UringEnter( scan, r, ring, ring->inflight > ring->pending );
+      UringReap( scan, r, ring, fd, total );
+   }
+}
+
+#endif
+
+/*
+        Classify one entry: add a file's size to `total', or remember a
+        subdirectory in `subdirs'.  Links are not followed.  Names left out
+        by /exclude or /include are dropped here, before a file is stat'ed
+        or a subdirectory is ever opened.
+*/
+
+void AddEntry( Scan *scan, Reader *r, int fd, char *name, int type, Total *total, NameList *subdirs )
+{
+   struct stat statbuf;
+   FileInfo fi;
+   unsigned long long start;
+   int status;
+
+   r->Entries++;
+
+   if( type == DT_UNKNOWN )
+   {
+      r->Stats++;
+      start  = StartCall( scan );
+      status = fstatat( fd, name, &statbuf, AT_SYMLINK_NOFOLLOW );
+      EndCall( scan, r, CALL_STAT, start );
+      if( status == -1 )
+         return;
+
+      if( (statbuf.st_mode & S_IFMT) == S_IFDIR )
+      {
+         if( !isDotDir( name ) && !Excluded( scan, name, TRUE ) )
+            NameAdd( subdirs, name );
+      }
+      else if( (statbuf.st_mode & S_IFMT) != S_IFLNK && !Excluded( scan, name, FALSE ) )
+      {
+         fi.size   = (long long) statbuf.st_size;
+         fi.blocks = (long long) statbuf.st_blocks;
+         fi.dev   = statbuf.st_dev;
+         fi.ino   = statbuf.st_ino;
+         fi.nlink = statbuf.st_nlink;
+         fi.mtime = statbuf.st_mtime;
+         fi.atime = statbuf.st_atime;
+         fi.uid   = statbuf.st_uid;
+         fi.gid   = statbuf.st_gid;
+         CountFile( scan, r, &fi, name, total );
+      }
+   }
+   else if( type == DT_DIR )
+   {
+      r->StatsAvoided++;
+      if( !isDotDir( name ) && !Excluded( scan, name, TRUE ) )
+         NameAdd( subdirs, name );
+   }
+   else if( type == DT_LNK )
+   {
+      r->StatsAvoided++;
+   }
+   else if( Excluded( scan, name, FALSE ) )
+   {
+      r->StatsAvoided++;
+   }
+#ifdef HAVE_URING
+   else if( scan->UringDepth > 0 && UringStat( scan, r, fd, name, total ) )
+   {
+      ;
+   }
+#endif
+   else if( StatFile( scan, r, fd, name, &fi ) == 0 )
+   {
+      CountFile( scan, r, &fi, name, total );
+   }
+}
+
+int CompareInodes( const void *a, const void *b )
+{
+   const InodeEntry *x = a, *y = b;
+
+   return( ( x->ino > y->ino ) - ( x->ino < y->ino ) );
+}
+
+/*
+        Hand the window on to AddEntry in inode order and empty it.
+*/
+
+void FlushWindow( Scan *scan, Reader *r, int fd, Total *total, NameList *subdirs )
+{
+   size_t i;
+
+   qsort( r->window, r->windowlen, sizeof(InodeEntry), CompareInodes );
+   for( i = 0; i < r->windowlen; i++ )
+      AddEntry( scan, r, fd, r->names + r->window[i].name, r->window[i].type, total, subdirs );
+   r->windowlen = 0;
+   r->nameslen  = 0;
+}
+
+/*
+        Pass one directory entry on, at once or, with /inode-order, by way
+        of the window.
+*/
+
+void QueueEntry( Scan *scan, Reader *r, int fd, char *name, int type, unsigned long long ino,
+                 Total *total, NameList *subdirs )
+{
+   InodeEntry *e;
+   size_t l;
+
+   if( !scan->InodeOrder )
+   {
+      AddEntry( scan, r, fd, name, type, total, subdirs );
+      return;
+   }
+
+   l = strlen( name ) + 1;
+   Reserve( (char **) &r->window, &r->windowsize, ( r->windowlen + 1 ) * sizeof(InodeEntry) );
+   Reserve( &r->names, &r->namessize, r->nameslen + l );
+   e = &r->window[ r->windowlen++ ];
+   e->ino  = ino;
+   e->name = r->nameslen;
+   e->type = type;
+   memcpy( r->names + r->nameslen, name, l );
+   r->nameslen += l;
+
+   if( r->windowlen == INODE_WINDOW )
+      FlushWindow( scan, r, fd, total, subdirs );
+}
+
+/*
+        Read the whole of the open directory `fd', adding its files into
+        `total' and its subdirectories onto `subdirs'.  `fd' stays open.
+        Returns -1 if the directory could not be read.
+*/
+
+int ReadDirectory( Scan *scan, Reader *r, int fd, Total *total, NameList *subdirs )
+{
+#ifdef __linux__
+   struct linux_dirent64 *d;
+   unsigned long long start;
+   long n, pos;
+
+   Reserve( &r->buf, &r->size, READ_BATCH );
+
+   for(;;)
+   {
+      start = StartCall( scan );
+      n     = syscall( SYS_getdents64, fd, r->buf, r->size );
+      EndCall( scan, r, CALL_READ, start );
+      if( n <= 0 )
+         break;
+
+      for( pos = 0; pos < n; pos += d->d_reclen )
+      {
+         d = (struct linux_dirent64 *)( r->buf + pos );
+         QueueEntry( scan, r, fd, d->d_name, d->d_type, d->d_ino, total, subdirs );
+      }
+   }
+   if( r->windowlen > 0 )
+      FlushWindow( scan, r, fd, total, subdirs );
+#ifdef HAVE_URING
+   UringDrain( scan, r, fd, total );
+#endif
+   return( n == 0 ? 0 : -1 );
+#else
+   DIR *mydir;
+   struct dirent *fbuf;
+   unsigned long long start;
+   int dfd;
+
+   if( -1 == ( dfd = dup( fd ) ) || NULL == ( mydir = fdopendir( dfd ) ) )
+   {
+      if( dfd != -1 )
+         close( dfd );
+      return( -1 );
+   }
+   for(;;)
+   {
+      start = StartCall( scan );
+      fbuf  = readdir( mydir );
+      EndCall( scan, r, CALL_READ, start );
+      if( fbuf == NULL )
+         break;
+#ifdef _DIRENT_HAVE_D_TYPE
+      QueueEntry( scan, r, fd, fbuf->d_name, fbuf->d_type, fbuf->d_ino, total, subdirs );
+#else
+      QueueEntry( scan, r, fd, fbuf->d_name, DT_UNKNOWN, fbuf->d_ino, total, subdirs );
+#endif
+   }
+   if( r->windowlen > 0 )
+      FlushWindow( scan, r, fd, total, subdirs );
+   closedir( mydir );
+   return( 0 );
+#endif
+}
+
+/*
+        Add one thread's counters into the overall ones.
+*/
+
+void AddCounters( Reader *to, Reader *from )
+{
+   SlowDir *slot;
+   int i, b;
+
+   to->Entries      += from->Entries;
+   to->Stats        += from->Stats;
+   to->StatsAvoided += from->StatsAvoided;
+   to->CacheHits    += from->CacheHits;
+   to->CacheMisses  += from->CacheMisses;
+   to->LinksSkipped += from->LinksSkipped;
+   to->Directories  += from->Directories;
+   to->UringStats   += from->UringStats;
+
+   AddDetail( &from->tree, &to->tree );
+   ClearDetail( &from->tree );
+   AddDups( to, from );
+
+   for( i = 0; i < CALLS; i++ )
+   {
+      to->Calls[i] += from->Calls[i];
+      to->Nanos[i] += from->Nanos[i];
+      for( b = 0; b < LATENCY_BUCKETS; b++ )
+         to->Latency[i][b] += from->Latency[i][b];
+   }
+
+          /* The paths move over to `to', or are dropped. */
+
+   for( i = 0; i < SLOWEST; i++ )
+   {
+      if( from->Slowest[i].nanos > 0 && NULL != ( slot = SlowSlot( to, from->Slowest[i].nanos ) ) )
+      {
+         free( slot->path );
+         *slot = from->Slowest[i];
+      }
+      else
+         free( from->Slowest[i].path );
+      from->Slowest[i].nanos = 0;
+      from->Slowest[i].path  = NULL;
+   }
+}
+
+/*
+        Write a nanosecond count as a short human readable time.
+*/
+
+char *FormatNanos( double ns, char *buf )
+{
+   if( ns < 1e3 )
+      sprintf( buf, "%.3gns", ns );
+   else if( ns < 1e6 )
+      sprintf( buf, "%.3gus", ns / 1e3 );
+   else if( ns < 1e9 )
+      sprintf( buf, "%.3gms", ns / 1e6 );
+   else
+      sprintf( buf, "%.3gs", ns / 1e9 );
+   return( buf );
+}
+
+/*
+        The upper bound of the histogram bucket holding the `p' quantile.
+*/
+
+double Quantile( unsigned long long *latency, unsigned long long calls, double p )
+{
+   unsigned long long seen = 0;
+   int b;
+
+   for( b = 0; b < LATENCY_BUCKETS - 1; b++ )
+   {
+      seen += latency[b];
+      if( (double) seen >= p * (double) calls )
+         break;
+   }
+   return( (double)( 1ULL << ( b + 1 ) ) );
+}
+
+int CompareSlow( const void *a, const void *b )
+{
+   const SlowDir *x = a, *y = b;
+
+   return( ( x->nanos < y->nanos ) - ( x->nanos > y->nanos ) );
+}
+
+/*
+        The /stats report on stderr: the counters, the rates, each kind of
+        call with its latency histogram, and the slowest directories.
+*/
+
+void PrintStats( Scan *scan, Reader *r, Total *total, unsigned long long nanos )
+{
+   static char *names[ CALLS ] = { "open", "read", "stat", "close", "output" };
+   double seconds = (double) nanos / 1e9;
+   char a[16], b[16], c[16];
+   int i, k;
+
+   fprintf( stderr, "edu: %llu entries, %llu stat calls, %llu stat calls avoided\n",
+            r->Entries, r->Stats, r->StatsAvoided );
+   if( scan->UringDepth > 0 )
+      fprintf( stderr, "edu: %llu stats made through io_uring; its stat row times io_uring_enter\n",
+               r->UringStats );
+   if( scan->cache != NULL )
+      fprintf( stderr, "edu: %llu directories reused from the index, %llu read\n",
+               r->CacheHits, r->CacheMisses );
+   if( scan->links != NULL )
+      fprintf( stderr, "edu: %llu extra hard links not counted\n", r->LinksSkipped );
+
+   fprintf( stderr, "edu: %llu directories, %llu files in %.3f seconds: %.0f directories/sec, %.0f files/sec\n",
+            r->Directories, total->Files, seconds,
+            seconds > 0.0 ? (double) r->Directories / seconds : 0.0,
+            seconds > 0.0 ? (double) total->Files / seconds : 0.0 );
+
+   for( i = 0; i < CALLS; i++ )
+   {
+      if( r->Calls[i] == 0 )
+         continue;
+
+      fprintf( stderr, "edu: %-6s %12llu calls %10.3f ms   mean %-8s p50 < %-8s p99 < %s\n",
+               names[i], r->Calls[i], (double) r->Nanos[i] / 1e6,
+               FormatNanos( (double) r->Nanos[i] / (double) r->Calls[i], a ),
+               FormatNanos( Quantile( r->Latency[i], r->Calls[i], 0.50 ), b ),
+               FormatNanos( Quantile( r->Latency[i], r->Calls[i], 0.99 ), c ) );
+
+      fprintf( stderr, "edu:       " );
+      for( k = 0; k < LATENCY_BUCKETS; k++ )
+         if( r->Latency[i][k] > 0 )
+            fprintf( stderr, " <%s:%llu", FormatNanos( (double)( 1ULL << ( k + 1 ) ), a ), r->Latency[i][k] );
+      fprintf( stderr, "\n" );
+   }
+
+   qsort( r->Slowest, SLOWEST, sizeof(SlowDir), CompareSlow );
+   if( r->Slowest[0].nanos > 0 )
+      fprintf( stderr, "edu: slowest directories to open and read:\n" );
+   for( i = 0; i < SLOWEST && r->Slowest[i].nanos > 0; i++ )
+   {
+      fprintf( stderr, "edu: %10.3f ms  %s\n", (double) r->Slowest[i].nanos / 1e6, r->Slowest[i].path );
+      free( r->Slowest[i].path );
+      r->Slowest[i].path = NULL;
+   }
+}
+
+/*
+        Scan index (/cache=FILE).
+
+        The index holds one record per directory: its device and inode, its
+        own mtime and ctime, the apparent and allocated sums and the count
+        of the files directly in it, and the names of its subdirectories.
+        If a directory's mtime and ctime have not changed since the last
+        run, no entry can have been added, removed or renamed, so the record
+        is used instead of reading the directory, and the engine goes
+        straight on to the subdirectories.
+        Note that a file rewritten in place does not change its directory's
+        times, so its new size is not seen until the directory changes.
+
+        The file is a header, the records, and an open addressing hash table
+        of (hash, record offset) slots keyed on device and inode.  The old
+        index is mapped and looked up in place; nothing is read into memory.
+        The new index is streamed out as directories are read, and only its
+        hash table is held in memory until it is written at the end.
+*/
+
+#define INDEX_MAGIC           "EDUIDX3"
+
+typedef struct indexhead{
+                         char               magic[8];
+                         unsigned long long records;
+                         unsigned long long table;      /* offset of slots */
+                         unsigned long long slots;      /* a power of two  */
+
+                    } IndexHead;
+
+typedef struct indexrec{
+                         unsigned long long dev;
+                         unsigned long long ino;
+                         long long          mtime, mtimens;
+                         long long          ctime, ctimens;
+                         unsigned long long bytes;      /* files directly in it */
+                         unsigned long long allocated;  /* the same, on disk    */
+                         unsigned long long files;      /* how many there are   */
+                         unsigned long long names;      /* bytes of names after */
+
+                    } IndexRec;
+
+typedef struct indexslot{
+                         unsigned long long hash;
+                         unsigned long long offset;     /* 0 = empty */
+
+                    } IndexSlot;
+
+typedef struct cache{
+                         char              *map;        /* previous index  */
+                         size_t             mapsize;
+                         IndexSlot         *slots;
+                         unsigned long long nslots;
+
+                         char              *name;       /* new index       */
+                         char              *tmpname;
+                         FILE              *out;
+                         unsigned long long offset;
+                         IndexSlot         *table;
+                         unsigned long long tablesize;
+                         unsigned long long records;
+                         pthread_mutex_t    lock;
+
+                    } Cache;
+
+
+/*
+        Map the previous index, if there is a usable one, and start the new.
+*/
+
+void CacheOpen( Cache *cache, char *name )
+{
+   IndexHead *head;
+   struct stat statbuf;
+   int fd;
+
+   memset( cache, 0, sizeof(Cache) );
+   pthread_mutex_init( &cache->lock, NULL );
+
+   if( -1 != ( fd = open( name, O_RDONLY | O_CLOEXEC ) ) )
+   {
+      if( fstat( fd, &statbuf ) == 0 && statbuf.st_size >= (off_t) sizeof(IndexHead) )
+      {
+         cache->mapsize = (size_t) statbuf.st_size;
+         cache->map     = mmap( NULL, cache->mapsize, PROT_READ, MAP_SHARED, fd, 0 );
+         if( cache->map == MAP_FAILED )
+            cache->map = NULL;
+      }
+      close( fd );
+   }
+
+   if( cache->map != NULL )
+   {
+      head = (IndexHead *) cache->map;
+      if( memcmp( head->magic, INDEX_MAGIC, 8 ) != 0 ||
+          head->slots == 0 || ( head->slots & ( head->slots - 1 ) ) != 0 ||
+          head->table % 8 != 0 || head->table > cache->mapsize ||
+          head->slots > ( cache->mapsize - head->table ) / sizeof(IndexSlot) )
+      {
+         fprintf(stderr,"edu: Ignoring unreadable index %s.\n", name );
+         munmap( cache->map, cache->mapsize );
+         cache->map = NULL;
+      }
+      else
+      {
+         cache->slots  = (IndexSlot *)( cache->map + head->table );
+         cache->nslots = head->slots;
+      }
+   }
+
+   cache->name    = name;
+   cache->tmpname = malloc( strlen( name ) + 32 );
+   if( cache->tmpname == NULL )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   sprintf( cache->tmpname, "%s.%ld", name, (long) getpid() );
+
+   if( NULL == ( cache->out = fopen( cache->tmpname, "wb" ) ) )
+   {
+      fprintf(stderr,"edu: Unable to create index %s\n", cache->tmpname );
+      perror("fopen:");
+      exit(1);
+   }
+   setvbuf( cache->out, NULL, _IOFBF, 1 << 20 );
+
+   cache->offset = sizeof(IndexHead);
+   fseek( cache->out, (long) cache->offset, SEEK_SET );
+}
+
+/*
+        Find the record for directory `statbuf' if it is still current.
+*/
+
+IndexRec *CacheLookup( Cache *cache, struct stat *statbuf )
+{
+   unsigned long long hash = DevInoHash( statbuf->st_dev, statbuf->st_ino );
+   unsigned long long i, off;
+   IndexRec *rec;
+
+   if( cache->map == NULL )
+      return( NULL );
+
+   for( i = hash & ( cache->nslots - 1 ); 0 != ( off = cache->slots[i].offset ); i = ( i + 1 ) & ( cache->nslots - 1 ) )
+   {
+      if( cache->slots[i].hash != hash )
+         continue;
+
+      if( off < sizeof(IndexHead) || off > cache->mapsize - sizeof(IndexRec) )
+         return( NULL );
+
+      rec = (IndexRec *)( cache->map + off );
+      if( rec->dev != (unsigned long long) statbuf->st_dev || rec->ino != (unsigned long long) statbuf->st_ino )
+         continue;
+
+      if( rec->names > cache->mapsize - off - sizeof(IndexRec) ||
+          ( rec->names > 0 && ((char *)( rec + 1 ))[ rec->names - 1 ] != 0 ) )
+         return( NULL );
+
+      if( rec->mtime   != (long long) statbuf->st_mtim.tv_sec ||
+          rec->mtimens != (long long) statbuf->st_mtim.tv_nsec ||
+          rec->ctime   != (long long) statbuf->st_ctim.tv_sec ||
+          rec->ctimens != (long long) statbuf->st_ctim.tv_nsec )
+         return( NULL );
+
+      return( rec );
+   }
+   return( NULL );
+}
+
+void CacheInsert( IndexSlot *table, unsigned long long size, unsigned long long hash, unsigned long long offset )
+{
+   unsigned long long i;
+
+   for( i = hash & ( size - 1 ); table[i].offset != 0; i = ( i + 1 ) & ( size - 1 ) )
+      ;
+   table[i].hash   = hash;
+   table[i].offset = offset;
+}
+
+/*
+        Append the record for one directory to the new index.
+*/
+
+void CacheStore( Cache *cache, struct stat *statbuf, unsigned long long bytes, unsigned long long allocated,
+                 unsigned long long files, char *names, size_t namelen )
+{
+   static char pad[8];
+   IndexRec rec;
+   unsigned long long i;
+
+   memset( &rec, 0, sizeof(rec) );
+   rec.dev     = statbuf->st_dev;
+   rec.ino     = statbuf->st_ino;
+   rec.mtime   = statbuf->st_mtim.tv_sec;
+   rec.mtimens = statbuf->st_mtim.tv_nsec;
+   rec.ctime   = statbuf->st_ctim.tv_sec;
+   rec.ctimens = statbuf->st_ctim.tv_nsec;
+   rec.bytes     = bytes;
+   rec.allocated = allocated;
+   rec.files     = files;
+   rec.names   = namelen;
+
+   pthread_mutex_lock( &cache->lock );
+
+          /* Keep the table at most half full. */
+
+   if( 2 * ( cache->records + 1 ) > cache->tablesize )
+   {
+      unsigned long long newsize = cache->tablesize ? cache->tablesize * 2 : 1024;
+      IndexSlot *table = calloc( newsize, sizeof(IndexSlot) );
+
+      if( table == NULL )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      for( i = 0; i < cache->tablesize; i++ )
+         if( cache->table[i].offset != 0 )
+            CacheInsert( table, newsize, cache->table[i].hash, cache->table[i].offset );
+      free( cache->table );
+      cache->table     = table;
+      cache->tablesize = newsize;
+   }
+
+   CacheInsert( cache->table, cache->tablesize, DevInoHash( rec.dev, rec.ino ), cache->offset );
+   cache->records++;
+
+   fwrite( &rec, sizeof(rec), 1, cache->out );
+   if( namelen > 0 )
+   {
+      fwrite( names, 1, namelen, cache->out );
+      fwrite( pad, 1, ( 8 - namelen % 8 ) % 8, cache->out );
+   }
+   cache->offset += sizeof(rec) + ( namelen + 7 ) / 8 * 8;
+
+   pthread_mutex_unlock( &cache->lock );
+}
+
+/*
+        Finish the new index and put it in place of the old one.
+*/
+
+void CacheClose( Cache *cache )
+{
+   IndexHead head;
+
+   if( cache->tablesize == 0 )
+   {
+      cache->tablesize = 1;
+      cache->table     = calloc( 1, sizeof(IndexSlot) );
+   }
+
+   memset( &head, 0, sizeof(head) );
+   memcpy( head.magic, INDEX_MAGIC, 8 );
+   head.records = cache->records;
+   head.table   = cache->offset;
+   head.slots   = cache->tablesize;
+
+   fwrite( cache->table, sizeof(IndexSlot), cache->tablesize, cache->out );
+   fseek( cache->out, 0L, SEEK_SET );
+   fwrite( &head, sizeof(head), 1, cache->out );
+
+   if( fclose( cache->out ) != 0 || rename( cache->tmpname, cache->name ) != 0 )
+   {
+      fprintf(stderr,"edu: Unable to write index %s\n", cache->name );
+      perror("edu:");
+      unlink( cache->tmpname );
+   }
+
+   if( cache->map != NULL )
+      munmap( cache->map, cache->mapsize );
+   free( cache->table );
+   free( cache->tmpname );
+   pthread_mutex_destroy( &cache->lock );
+}
+
+#endif /* UNIX */
+
+#ifdef UNIX
+
+/*
+        Read one open directory for the engines, through the index if there
+        is one.  Same contract as ReadDirectory.
+*/
+
+int ScanDirectory( Scan *scan, Reader *r, int fd, Total *total, NameList *subdirs )
+{
+   struct stat statbuf;
+   IndexRec *rec;
+   Total own = {0,0,0};
+   size_t start = subdirs->len;
+   unsigned long long bytes, allocated, files;
+   int status = 0;
+
+   if( scan->cache == NULL || fstat( fd, &statbuf ) == -1 )
+      return( ReadDirectory( scan, r, fd, total, subdirs ) );
+
+   if( NULL != ( rec = CacheLookup( scan->cache, &statbuf ) ) )
+   {
+      r->CacheHits++;
+      bytes     = rec->bytes;
+      allocated = rec->allocated;
+      files     = rec->files;
+      if( rec->names > 0 )
+      {
+         Reserve( &subdirs->buf, &subdirs->size, subdirs->len + rec->names );
+         memcpy( subdirs->buf + subdirs->len, rec + 1, rec->names );
+         subdirs->len += rec->names;
+      }
+   }
+   else
+   {
+      r->CacheMisses++;
+      status    = ReadDirectory( scan, r, fd, &own, subdirs );
+      bytes     = own.Bytes;
+      allocated = own.Allocated;
+      files     = own.Files;
+   }
+
+   total->Bytes     += bytes;
+   total->Allocated += allocated;
+   total->Files     += files;
+
+   if( status == 0 )
+      CacheStore( scan->cache, &statbuf, bytes, allocated, files, subdirs->buf + start, subdirs->len - start );
+
+   return( status );
+}
+
+/*
+        /estimate: an approximate total without reading the whole tree.
+
+        The top levels are counted in full, breadth first: down to /level
+        when it is given, otherwise until ESTIMATE_FRONTIER directories are
+        left below them.  The subtrees under those frontier directories are
+        then sampled.  A probe picks a frontier directory at random and
+        walks down from it, one random subdirectory at a time, to a leaf.
+        Each directory on the walk stands for all of the directories at its
+        depth that the walk could have reached, so its own files are
+        weighted by the product of the fan-outs above it (Knuth's estimate
+        of the size of a tree).  Times the number of frontier directories,
+        that is a fair guess at everything below the frontier.
+
+        Probes go on until the 95% confidence interval of the mean is
+        within the requested error of the whole total, or ESTIMATE_PROBES
+        have been made.  Skewed trees, where a few deep subtrees hold most
+        of the bytes, take the most probes.  Each directory is read once:
+        what was found is kept in a tree of EstNodes, so later probes
+        through the same directories cost no calls, and no estimate ever
+        reads more than a full count would.  A node keeps only its own
+        name; the full name is put together when it is first read.
+*/
+
+#define ESTIMATE_FRONTIER     1024
+#define ESTIMATE_MIN_PROBES   64
+#define ESTIMATE_PROBES       ( 1 << 22 )
+#define ESTIMATE_Z            1.96        /* 95% confidence */
+#define ESTIMATE_PIECE        2048        /* longest name opened at once */
+
+#define ESTIMATE_BYTES        0
+#define ESTIMATE_ALLOCATED    1
+#define ESTIMATE_FILES        2
+#define ESTIMATE_DIRS         3
+#define ESTIMATE_SUMS         4
+
+typedef struct estnode{
+                         char               *name;
+                         struct estnode     *parent;       /* NULL for dirname */
+                         Total               own;
+                         struct estnode     *subdirs;
+                         size_t              nsubdirs;
+                         int                 read;         /* 0 not yet, -1 could not be */
+
+                    } EstNode;
+
+typedef struct estimate{
+                         Total               exact;        /* the levels counted in full */
+                         unsigned long long  exactdirs;
+                         Total               read;         /* everything read, for /stats */
+                         unsigned long long  readdirs;
+                         unsigned long long  unread;       /* EstNodes not yet visited */
+                         EstNode           **front;        /* below the levels counted */
+                         size_t              nfront;
+                         PathBuf             path;
+                         void              **blocks;       /* EstNodes to free */
+                         size_t              nblocks, blockssize;
+                         unsigned long long  probes;
+                         double              mean[ ESTIMATE_SUMS ];
+                         double              m2[ ESTIMATE_SUMS ];
+                         unsigned long long  seed;
+
+                    } Estimate;
+
+/*
+        xorshift64*, as in bench/edutree.c.
+*/
+
+unsigned long long EstimateRandom( Estimate *e )
+{
+   e->seed ^= e->seed >> 12;
+   e->seed ^= e->seed << 25;
+   e->seed ^= e->seed >> 27;
+   return( e->seed * 0x2545F4914F6CDD1DULL );
+}
+
+void *EstimateAlloc( Estimate *e, size_t size )
+{
+   Reserve( (char **) &e->blocks, &e->blockssize, ( e->nblocks + 1 ) * sizeof(void *) );
+   if( NULL == ( e->blocks[ e->nblocks ] = malloc( size ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   return( e->blocks[ e->nblocks++ ] );
+}
+
+/*
+        Open a file or directory by its full name.  A name longer than the
+        system takes is opened a piece at a time, each piece below the last.
+*/
+
+int OpenPath( char *name, size_t len, char PathDelimiter, int flags )
+{
+   char *p = name, *cut;
+   int fd = AT_FDCWD, next;
+
+   while( len - (size_t)( p - name ) > ESTIMATE_PIECE )
+   {
+      for( cut = p + ESTIMATE_PIECE; cut > p && *cut != PathDelimiter; cut-- )
+         ;
+      if( cut == p )
+         break;
+
+      *cut = 0;
+      next = openat( fd, p, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+      *cut = PathDelimiter;
+
+      if( fd != AT_FDCWD )
+         close( fd );
+      if( next == -1 )
+         return( -1 );
+      fd = next;
+      p  = cut + 1;
+   }
+
+   next = openat( fd, p, flags );
+   if( fd != AT_FDCWD )
+      close( fd );
+   return( next );
+}
+
+/*
+        Read a directory for the first time: its own files into the node,
+        and its subdirectories into new EstNodes, their names in the same
+        block.  Only dirname itself may be a link.  A directory that cannot
+        be read, or is on another device with /xdev, is marked so and
+        counts as empty.
+*/
+
+void EstimateVisit( Scan *scan, Reader *r, Estimate *e, EstNode *node, NameList *subdirs )
+{
+   struct stat statbuf;
+   unsigned long long start;
+   EstNode *up, *kids;
+   char *names;
+   size_t sub, count = 0, len = 0, l, i;
+   int fd;
+
+          /* The full name, from the node up. */
+
+   for( up = node; up != NULL; up = up->parent )
+      len += strlen( up->name ) + 1;
+   Reserve( &e->path.buf, &e->path.size, len );
+   e->path.len = len - 1;
+   for( up = node; up != NULL; up = up->parent )
+   {
+      l    = strlen( up->name );
+      len -= l + 1;
+      memcpy( e->path.buf + len, up->name, l );
+      e->path.buf[ len + l ] = ( up == node ) ? 0 : scan->PathDelimiter;
+   }
+
+   node->read = -1;
+   e->unread--;
+
+   start = StartCall( scan );
+   fd = OpenPath( e->path.buf, e->path.len, scan->PathDelimiter,
+                      O_RDONLY | O_DIRECTORY | O_CLOEXEC | ( node->parent != NULL ? O_NOFOLLOW : 0 ) );
+   EndCall( scan, r, CALL_OPEN, start );
+
+   if( fd == -1 )
+      return;
+
+   if( scan->OneFilesystem && node->parent != NULL && fstat( fd, &statbuf ) == 0 &&
+       (unsigned long long) statbuf.st_dev != scan->Device )
+   {
+      close( fd );
+      return;
+   }
+
+   subdirs->len = 0;
+   ReadDirectory( scan, r, fd, &node->own, subdirs );
+   r->Directories++;
+
+   start = StartCall( scan );
+   close( fd );
+   EndCall( scan, r, CALL_CLOSE, start );
+
+   node->read = 1;
+   AddTotal( &node->own, &e->read );
+   e->readdirs++;
+
+   for( sub = 0; sub < subdirs->len; sub += strlen( subdirs->buf + sub ) + 1 )
+      count++;
+   if( count == 0 )
+      return;
+
+   kids  = EstimateAlloc( e, count * sizeof(EstNode) + subdirs->len );
+   names = (char *)( kids + count );
+   memcpy( names, subdirs->buf, subdirs->len );
+
+   for( i = 0, sub = 0; i < count; i++, sub += strlen( names + sub ) + 1 )
+   {
+      memset( &kids[i], 0, sizeof(EstNode) );
+      kids[i].name   = names + sub;
+      kids[i].parent = node;
+   }
+
+   node->subdirs  = kids;
+   node->nsubdirs = count;
+   e->unread     += count;
+}
+
+/*
+        Count the top levels of `dirname' in full, breadth first, and leave
+        the directories below them on the frontier.  `levels' is the number
+        of levels to count, or 0 to stop once the frontier is wide enough.
+*/
+
+void EstimateTop( char *dirname, Scan *scan, Reader *r, Estimate *e, int levels, NameList *subdirs )
+{
+   EstNode **level = NULL, **next = NULL, **swap, *root;
+   size_t nlevel = 1, nnext, sizelevel = 0, sizenext = 0, i, k;
+   int depth;
+
+   root = EstimateAlloc( e, sizeof(EstNode) );
+   memset( root, 0, sizeof(EstNode) );
+   root->name = dirname;
+   e->unread  = 1;
+
+   Reserve( (char **) &level, &sizelevel, sizeof(EstNode *) );
+   level[0] = root;
+
+   for( depth = 1; nlevel > 0; depth++ )
+   {
+      nnext = 0;
+
+      for( i = 0; i < nlevel; i++ )
+      {
+         EstimateVisit( scan, r, e, level[i], subdirs );
+         if( level[i]->read < 0 )
+         {
+            if( depth == 1 )
+            {
+               fprintf(stderr,"Unable to open directory: %s\n", dirname );
+               perror("opendir:");
+               exit(1);
+            }
+            continue;
+         }
+
+         AddTotal( &level[i]->own, &e->exact );
+         e->exactdirs++;
+
+         Reserve( (char **) &next, &sizenext, ( nnext + level[i]->nsubdirs ) * sizeof(EstNode *) );
+         for( k = 0; k < level[i]->nsubdirs; k++ )
+            next[ nnext++ ] = &level[i]->subdirs[k];
+      }
+
+      swap   = level;  level     = next;      next     = swap;
+      k      = sizelevel; sizelevel = sizenext; sizenext = k;
+      nlevel = nnext;
+
+      if( levels > 0 ? depth >= levels : nlevel >= ESTIMATE_FRONTIER )
+         break;
+   }
+
+          /* What is left below the last level counted is sampled. */
+
+   e->front  = level;
+   e->nfront = nlevel;
+   free( next );
+}
+
+/*
+        One probe: a random walk from a random frontier directory down to a
+        leaf.  Its estimate of everything below the frontier is folded into
+        the running means and sums of squares (Welford's method).
+*/
+
+void EstimateProbe( Scan *scan, Reader *r, Estimate *e, NameList *subdirs )
+{
+   double x[ ESTIMATE_SUMS ] = { 0.0, 0.0, 0.0, 0.0 };
+   double weight = 1.0, delta;
+   EstNode *node = e->front[ EstimateRandom( e ) % e->nfront ];
+   int i;
+
+   for(;;)
+   {
+      if( node->read == 0 )
+         EstimateVisit( scan, r, e, node, subdirs );
+      if( node->read < 0 )
+         break;
+
+      x[ ESTIMATE_BYTES ]     += weight * (double) node->own.Bytes;
+      x[ ESTIMATE_ALLOCATED ] += weight * (double) node->own.Allocated;
+      x[ ESTIMATE_FILES ]     += weight * (double) node->own.Files;
+      x[ ESTIMATE_DIRS ]      += weight;
+
+      if( node->nsubdirs == 0 )
+         break;
+      weight *= (double) node->nsubdirs;
+      node    = &node->subdirs[ EstimateRandom( e ) % node->nsubdirs ];
+   }
+
+   e->probes++;
+   for( i = 0; i < ESTIMATE_SUMS; i++ )
+   {
+      x[i]       *= (double) e->nfront;
+      delta       = x[i] - e->mean[i];
+      e->mean[i] += delta / (double) e->probes;
+      e->m2[i]   += delta * ( x[i] - e->mean[i] );
+   }
+}
+
+/*
+        A square root by Newton's method, so edu needs no maths library.
+*/
+
+double EstimateRoot( double x )
+{
+   double y = x > 1.0 ? x : 1.0, last;
+
+   if( x <= 0.0 )
+      return( 0.0 );
+   do
+   {
+      last = y;
+      y    = ( y + x / y ) / 2.0;
+   } while( y < last );
+   return( last );
+}
+
+/*
+        Half the width of the confidence interval of quantity `i'.
+*/
+
+double EstimateMargin( Estimate *e, int i )
+{
+   if( e->probes < 2 )
+      return( 0.0 );
+   return( ESTIMATE_Z * EstimateRoot( e->m2[i] / (double)( e->probes - 1 ) / (double) e->probes ) );
+}
+
+/*
+        Estimate the total of `dirname' to within `error' (a fraction) of
+        it, and print the estimate and its margin.  Returns what was read.
+*/
+
+Total EstimateTotal( char *dirname, Scan *scan, Reader *r, double error, int levels )
+{
+   NameList subdirs = { NULL, 0, 0 };
+   Estimate e;
+   Total t;
+   double margin, size;
+   int ranked = ( scan->Sizes == SIZE_ALLOCATED ) ? ESTIMATE_ALLOCATED : ESTIMATE_BYTES;
+   int unit;
+   size_t i;
+   char a[32];
+
+   memset( &e, 0, sizeof(e) );
+   e.seed = ( (unsigned long long) time( NULL ) ^ ( (unsigned long long) getpid() << 32 ) ) | 1;
+
+   EstimateTop( dirname, scan, r, &e, levels, &subdirs );
+
+   while( e.nfront > 0 && e.probes < ESTIMATE_PROBES )
+   {
+      EstimateProbe( scan, r, &e, &subdirs );
+
+      size = (double) TotalBytes( &e.exact, scan->Sizes ) + e.mean[ ranked ];
+      if( e.probes >= ESTIMATE_MIN_PROBES && EstimateMargin( &e, ranked ) <= error * size )
+         break;
+
+          /* The probes have read the whole tree: it is counted in full. */
+
+      if( e.unread == 0 )
+      {
+         e.exact     = e.read;
+         e.exactdirs = e.readdirs;
+         e.nfront    = 0;
+         memset( e.mean, 0, sizeof(e.mean) );
+      }
+   }
+
+   t.Bytes     = e.exact.Bytes     + (Counter)( e.mean[ ESTIMATE_BYTES ] + 0.5 );
+   t.Allocated = e.exact.Allocated + (Counter)( e.mean[ ESTIMATE_ALLOCATED ] + 0.5 );
+   t.Files     = e.exact.Files     + (Counter)( e.mean[ ESTIMATE_FILES ] + 0.5 );
+
+   PrintTotal( &t, scan->Sizes, scan->Units, dirname );
+
+   if( e.nfront == 0 )
+      printf( "          exact, %llu files in %llu directories\n", t.Files, e.exactdirs );
+   else
+   {
+      margin = EstimateMargin( &e, ranked );
+      size   = (double) TotalBytes( &t, scan->Sizes );
+      unit   = UnitOf( (Counter) TotalBytes( &t, scan->Sizes ), scan->Units );
+      printf( "          +/- %s %s (%.2f%%) at 95%% confidence, about %llu files in %.0f directories,"
+              " from %llu probes and %llu directories read\n",
+              FormatSize( (Counter)( margin + 0.5 ), FALSE, FALSE, unit, a ), UnitNames[ unit ],
+              size > 0.0 ? 100.0 * margin / size : 0.0,
+              t.Files, (double) e.exactdirs + e.mean[ ESTIMATE_DIRS ],
+              e.probes, r->Directories );
+   }
+
+   for( i = 0; i < e.nblocks; i++ )
+      free( e.blocks[i] );
+   free( e.blocks );
+   free( e.front );
+   free( e.path.buf );
+   free( subdirs.buf );
+   free( r->buf );
+   free( r->window );
+   free( r->names );
+#ifdef HAVE_URING
+   UringClose( r->ring );
+#endif
+   return( e.read );
+}
+
+
+/*
+        Sharding (/shard=K/N).  The directories at /shard-depth (the top
+        directory is level 1) are dealt out among N shards by a hash of
+        their path below dirname, so hosts that mount the tree in
+        different places deal them out alike.  Shard K counts only the
+        ones dealt to it, with everything below them.  The levels above
+        are read by every shard to find them, but their own files are
+        counted by shard 1 alone.
+*/
+
+int ShardOwns( Scan *scan, char *rel, char *name )
+{
+   unsigned long long h = 0xCBF29CE484222325ULL;
+
+   for( ; *rel != 0; rel++ )
+      h = ( h ^ (unsigned char) *rel ) * 0x100000001B3ULL;
+   h = ( h ^ (unsigned char) scan->PathDelimiter ) * 0x100000001B3ULL;
+   for( ; *name != 0; name++ )
+      h = ( h ^ (unsigned char) *name ) * 0x100000001B3ULL;
+
+   h ^= h >> 32;
+   return( (int)( h % (unsigned long long) scan->Shards ) == scan->Shard );
+}
+
+/*
+        Whether this shard counts the files of a directory at `level'.
+*/
+
+int ShardCounts( Scan *scan, int level )
+{
+   return( scan->Shards == 0 || level >= scan->ShardDepth || scan->Shard == 0 );
+}
+
+/*
+        Merging shards (/merge).  Each file is the output of one /shard=K/N
+        scan of the same tree: one tree in name order, like a snapshot for
+        /diff.  They are streamed side by side the same way, and the
+        records of a directory found in several of them are summed.  A
+        directory at /shard-depth or below is in one file only, and those
+        above it are in every file, each record holding that shard's part,
+        so every sum is the exact total of the whole tree.  Directories
+        come out parents first, under the top directory of the first file
+        given.  Nothing is held but the current record of each file.
+*/
+
+typedef struct merge{
+                         Snapshot           *snap;
+                         int                *more;      /* snap[i].rec is live */
+                         int                 n;
+                         int                 limit;     /* deepest level       */
+                         char               *root;
+
+                    } Merge;
+
+void MergeInit( Merge *m, NameList *files, int limit, char PathDelimiter )
+{
+   unsigned int first, shard, shards;
+   char *seen;
+   size_t at;
+   int i;
+
+   memset( m, 0, sizeof(Merge) );
+   m->limit = limit;
+
+   for( at = 0; at < files->len; at += strlen( files->buf + at ) + 1 )
+      m->n++;
+   if( m->n == 0 ||
+       NULL == ( m->snap = calloc( (size_t) m->n, sizeof(Snapshot) ) ) ||
+       NULL == ( m->more = calloc( (size_t) m->n, sizeof(int) ) ) )
+   {
+      fprintf(stderr, m->n == 0 ? "edu: /merge needs the shard files.\n" : "edu: Out of memory.\n" );
+      exit(1);
+   }
+
+          /* The names were taken from the end of the command line. */
+
+   for( i = m->n, at = 0; at < files->len; at += strlen( files->buf + at ) + 1 )
+   {
+      SnapOpen( &m->snap[ --i ], files->buf + at );
+      if( !( m->more[i] = SnapNext( &m->snap[i], limit, PathDelimiter ) ) )
+      {
+         fprintf(stderr,"edu: %s is empty.\n", m->snap[i].name );
+         exit(1);
+      }
+   }
+
+          /* One of each shard of one scan, or the sums are not the tree. */
+
+   first  = m->snap[0].rec.shard;
+   shards = first & 0xFFF;
+   if( NULL == ( seen = calloc( shards + 1, 1 ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   for( i = 0; i < m->n; i++ )
+   {
+      shard = ( m->snap[i].rec.shard >> 12 ) & 0xFFF;
+      if( m->snap[i].rec.shard == 0 )
+      {
+         fprintf(stderr,"edu: %s is not a /shard file.\n", m->snap[i].name );
+         exit(1);
+      }
+      if( ( m->snap[i].rec.shard & 0xFFF ) != shards || m->snap[i].rec.shard >> 24 != first >> 24 )
+      {
+         fprintf(stderr,"edu: %s and %s are not shards of one scan.\n", m->snap[0].name, m->snap[i].name );
+         exit(1);
+      }
+      if( seen[ shard ] )
+      {
+         fprintf(stderr,"edu: Shard %u/%u is given twice.\n", shard, shards );
+         exit(1);
+      }
+      seen[ shard ] = TRUE;
+   }
+   for( shard = 1; shard <= shards; shard++ )
+   {
+      if( !seen[ shard ] )
+      {
+         fprintf(stderr,"edu: Shard %u/%u is missing.\n", shard, shards );
+         exit(1);
+      }
+   }
+   free( seen );
+
+   if( NULL == ( m->root = strdup( m->snap[0].path ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+}
+
+/*
+        Merge the files to the end, reporting each directory as the engines
+        do, and return the top directory's total.
+*/
+
+Total MergeTotal( Merge *m, Scan *scan )
+{
+   PathBuf path;
+   Snapshot *s;
+   Total total, top = {0,0,0};
+   size_t rootlen;
+   char *rel;
+   int i, level;
+
+   PathInit( &path, m->root );
+   rootlen = path.len;
+
+   for(;;)
+   {
+      for( rel = NULL, level = 0, i = 0; i < m->n; i++ )
+      {
+         s = &m->snap[i];
+         if( m->more[i] && ( rel == NULL || ComparePaths( s->path + s->rootlen, rel, scan->PathDelimiter ) < 0 ) )
+         {
+            rel   = s->path + s->rootlen;
+            level = (int) s->rec.depth;
+         }
+      }
+      if( rel == NULL )
+         break;
+
+      PathPop( &path, rootlen );
+      Reserve( &path.buf, &path.size, rootlen + strlen( rel ) + 1 );
+      strcpy( path.buf + rootlen, rel );
+      path.len = rootlen + strlen( rel );
+
+      memset( &total, 0, sizeof(total) );
+      for( i = 0; i < m->n; i++ )
+      {
+         s = &m->snap[i];
+         if( m->more[i] && 0 == ComparePaths( s->path + s->rootlen, path.buf + rootlen, scan->PathDelimiter ) )
+         {
+            total.Bytes     += s->rec.bytes;
+            total.Allocated += s->rec.allocated;
+            total.Files     += s->rec.files;
+            m->more[i] = SnapNext( s, m->limit, scan->PathDelimiter );
+         }
+      }
+
+      if( level == 1 )
+         top = total;
+      if( scan->total_only == FALSE && level <= scan->RecursionLimit )
+         ReportTotal( scan, &total, NULL, &path, level );
+   }
+
+   for( i = 0; i < m->n; i++ )
+      SnapClose( &m->snap[i] );
+   free( m->snap );
+   free( m->more );
+   free( path.buf );
+   return( top );
+}
+
+/*
+        Finding the duplicates (/duplicates).  Files are compared in
+        stages, each cheaper stage leaving fewer files for the next:
+
+           1. Sizes.  Only files whose size is seen more than once can be
+              duplicates.  Further links to an inode already in the list
+              are dropped, so hard links are never reported as copies.
+           2. The first and last DUP_EDGE bytes of each file, hashed.
+              Small files are read whole here, and go no further.
+           3. The whole file, hashed, read in DUP_READ pieces.
+           4. The bytes.  Each group whose size and hashes all match is
+              read once more and compared byte for byte, so that only
+              files that really are the same are reported as copies.
+
+        The hash is 64 bits wide, four independent lanes in the manner of
+        xxHash64, which the compiler can keep in registers side by side;
+        it is not cryptographic, which is why the last stage is there.
+        Stages 2 to 4 are read by a pool of threads, each taking the next
+        file, or group, as it is done; large sequential reads are used
+        rather than mmap, so that a file cut short while it is read is an
+        error rather than a SIGBUS.
+*/
+
+#define DUP_EDGE              4096
+#define DUP_READ              ( 1 << 20 )
+
+#define DUP_HEAD              2         /* the stages */
+#define DUP_WHOLE             3
+#define DUP_BYTES             4
+
+#define DUP_P1                0x9E3779B185EBCA87ULL
+#define DUP_P2                0xC2B2AE3D27D4EB4FULL
+#define DUP_P3                0x165667B19E3779F9ULL
+#define DUP_P4                0x85EBCA77C2B2AE63ULL
+#define DUP_P5                0x27D4EB2F165667C5ULL
+
+typedef struct duphash{
+                         unsigned long long  v[4];
+                         unsigned long long  len;
+
+                    } DupHash;
+
+typedef struct duppool{
+                         Dups               *dups;
+                         DupFile           **todo;
+                         size_t              n;
+                         size_t              next;      /* taken so far   */
+                         int                 stage;     /* DUP_*          */
+                         char                PathDelimiter;
+
+                    } DupPool;
+
+static char *DupNames;                  /* for the comparisons */
+
+unsigned long long DupRotate( unsigned long long x, int r )
+{
+   return( ( x << r ) | ( x >> ( 64 - r ) ) );
+}
+
+unsigned long long DupWord( const unsigned char *p )
+{
+   unsigned long long v;
+
+   memcpy( &v, p, sizeof(v) );
+   return( v );
+}
+
+unsigned long long DupRound( unsigned long long acc, unsigned long long word )
+{
+   return( DupRotate( acc + word * DUP_P2, 31 ) * DUP_P1 );
+}
+
+void DupHashInit( DupHash *h, unsigned long long seed )
+{
+   h->v[0] = seed + DUP_P1 + DUP_P2;
+   h->v[1] = seed + DUP_P2;
+   h->v[2] = seed;
+   h->v[3] = seed - DUP_P1;
+   h->len  = 0;
+}
+
+/*
+        Hash `len' bytes, a multiple of 32 unless it is the last of them.
+        The remainder, if any, is taken in by DupHashEnd.
+*/
+
+size_t DupHashAdd( DupHash *h, const unsigned char *p, size_t len )
+{
+   unsigned long long v0 = h->v[0], v1 = h->v[1], v2 = h->v[2], v3 = h->v[3];
+   size_t i;
+
+   for( i = 0; i + 32 <= len; i += 32 )
+   {
+      v0 = DupRound( v0, DupWord( p + i ) );
+      v1 = DupRound( v1, DupWord( p + i + 8 ) );
+      v2 = DupRound( v2, DupWord( p + i + 16 ) );
+      v3 = DupRound( v3, DupWord( p + i + 24 ) );
+   }
+   h->v[0] = v0;
+   h->v[1] = v1;
+   h->v[2] = v2;
+   h->v[3] = v3;
+   h->len += len;
+   return( i );
+}
+
+unsigned long long DupHashEnd( DupHash *h, const unsigned char *p, size_t len )
+{
+   unsigned long long acc;
+   size_t i;
+   int k;
+
+   acc = DupRotate( h->v[0], 1 ) + DupRotate( h->v[1], 7 ) + DupRotate( h->v[2], 12 ) + DupRotate( h->v[3], 18 );
+   for( k = 0; k < 4; k++ )
+      acc = ( acc ^ DupRound( 0, h->v[k] ) ) * DUP_P1 + DUP_P4;
+   acc += h->len;
+
+   for( i = 0; i + 8 <= len; i += 8 )
+      acc = DupRotate( acc ^ DupRound( 0, DupWord( p + i ) ), 27 ) * DUP_P1 + DUP_P4;
+   for( ; i < len; i++ )
+      acc = DupRotate( acc ^ ( p[i] * DUP_P5 ), 11 ) * DUP_P1;
+
+   acc ^= acc >> 33;
+   acc *= DUP_P2;
+   acc ^= acc >> 29;
+   acc *= DUP_P3;
+   acc ^= acc >> 32;
+   return( acc );
+}
+
+unsigned long long DupHashBuffer( const unsigned char *p, size_t len, unsigned long long seed )
+{
+   DupHash h;
+   size_t done;
+
+   DupHashInit( &h, seed );
+   done = DupHashAdd( &h, p, len );
+   return( DupHashEnd( &h, p + done, len - done ) );
+}
+
+/*
+        Read up to `len' bytes at `offset', going on after short reads.
+*/
+
+ssize_t DupRead( int fd, unsigned char *buf, size_t len, off_t offset )
+{
+   size_t done = 0;
+   ssize_t n;
+
+   while( done < len )
+   {
+      if( 0 > ( n = pread( fd, buf + done, len - done, offset + (off_t) done ) ) )
+      {
+         if( errno == EINTR )
+            continue;
+         return( -1 );
+      }
+      if( n == 0 )
+         break;
+      done += (size_t) n;
+   }
+   return( (ssize_t) done );
+}
+
+/*
+        Open a noted file, and make sure it is still the one that was
+        counted: a regular file with the same inode and size.
+*/
+
+int DupOpen( DupPool *pool, DupFile *f, PathBuf *path )
+{
+   struct stat statbuf;
+   int fd;
+
+   path->len = strlen( pool->dups->names.buf + f->dir );
+   Reserve( &path->buf, &path->size, path->len + 1 );
+   strcpy( path->buf, pool->dups->names.buf + f->dir );
+   PathPush( path, pool->PathDelimiter, pool->dups->names.buf + f->name );
+
+   fd = OpenPath( path->buf, path->len, pool->PathDelimiter, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOATIME );
+   if( fd == -1 && errno == EPERM )
+      fd = OpenPath( path->buf, path->len, pool->PathDelimiter, O_RDONLY | O_CLOEXEC | O_NOFOLLOW );
+   if( fd == -1 )
+      return( -1 );
+
+   if( fstat( fd, &statbuf ) == -1 || !S_ISREG( statbuf.st_mode ) ||
+       (unsigned long long) statbuf.st_dev  != f->dev ||
+       (unsigned long long) statbuf.st_ino  != f->ino ||
+       (unsigned long long) statbuf.st_size != f->size )
+   {
+      close( fd );
+      return( -1 );
+   }
+   return( fd );
+}
+
+/*
+        Stage 2: the first and last DUP_EDGE bytes, or the whole of a file
+        no longer than both.
+*/
+
+int DupHead( int fd, DupFile *f, unsigned char *buf )
+{
+   size_t len = f->size <= 2 * DUP_EDGE ? (size_t) f->size : 2 * DUP_EDGE;
+
+   if( len == f->size )
+   {
+      if( DupRead( fd, buf, len, 0 ) != (ssize_t) len )
+         return( FALSE );
+   }
+   else if( DupRead( fd, buf, DUP_EDGE, 0 ) != DUP_EDGE ||
+            DupRead( fd, buf + DUP_EDGE, DUP_EDGE, (off_t)( f->size - DUP_EDGE ) ) != DUP_EDGE )
+      return( FALSE );
+
+   f->head = DupHashBuffer( buf, len, f->size );
+   if( len == f->size )
+      f->hash = f->head;
+   return( TRUE );
+}
+
+/*
+        Stage 3: the whole file, in order, told to the kernel as such so
+        that it reads ahead.
+*/
+
+int DupWhole( int fd, DupFile *f, unsigned char *buf )
+{
+   unsigned long long offset = 0;
+   DupHash h;
+   size_t want, done = 0;
+   ssize_t n = 0;
+
+   posix_fadvise( fd, 0, 0, POSIX_FADV_SEQUENTIAL );
+
+   DupHashInit( &h, f->size );
+   while( offset < f->size )
+   {
+      want = f->size - offset < DUP_READ ? (size_t)( f->size - offset ) : DUP_READ;
+      if( ( n = DupRead( fd, buf, want, (off_t) offset ) ) != (ssize_t) want )
+         return( FALSE );
+      offset += want;
+      if( offset < f->size )
+         DupHashAdd( &h, buf, want );
+   }
+
+   done = DupHashAdd( &h, buf, (size_t) n );
+   f->hash = DupHashEnd( &h, buf + done, (size_t) n - done );
+   return( TRUE );
+}
+
+/*
+        Whether two files in the sorted list match as far as known.
+*/
+
+int SameDups( DupFile *x, DupFile *y )
+{
+   return( x->size == y->size && x->head == y->head && x->hash == y->hash && x->same == y->same );
+}
+
+/*
+        Stage 4: compare two open files of `size' bytes.  Returns TRUE if
+        every byte is the same, FALSE if not, and -1 if `b' could not be
+        read; `a' has been read before and is taken to be readable.
+*/
+
+int DupEqual( int a, int b, unsigned long long size, unsigned char *bufa, unsigned char *bufb )
+{
+   unsigned long long offset;
+   size_t want;
+
+   for( offset = 0; offset < size; offset += want )
+   {
+      want = size - offset < DUP_READ ? (size_t)( size - offset ) : DUP_READ;
+      if( DupRead( b, bufb, want, (off_t) offset ) != (ssize_t) want )
+         return( -1 );
+      if( DupRead( a, bufa, want, (off_t) offset ) != (ssize_t) want )
+         return( FALSE );
+      if( 0 != memcmp( bufa, bufb, want ) )
+         return( FALSE );
+   }
+   return( TRUE );
+}
+
+/*
+        Stage 4 for the group starting at `g': each file not yet matched
+        is compared with the rest that are not, and marks those with the
+        same bytes as its own.  In the usual group, all the same, each
+        file is read once and the first once per other file.
+*/
+
+void DupCompare( DupPool *pool, DupFile *g, PathBuf *path, unsigned char *bufa, unsigned char *bufb )
+{
+   DupFile *end = pool->dups->file + pool->dups->n;
+   size_t n, i, j;
+   int a, b, same;
+
+   for( n = 1; g + n < end && SameDups( g, g + n ); n++ )
+      ;
+   for( i = 0; i < n; i++ )
+      g[i].same = (size_t) -1;
+
+   for( i = 0; i < n; i++ )
+   {
+      if( g[i].same != (size_t) -1 )
+         continue;
+      g[i].same = i;
+      if( -1 == ( a = DupOpen( pool, &g[i], path ) ) )
+      {
+         g[i].failed = TRUE;
+         continue;
+      }
+      for( j = i + 1; j < n; j++ )
+      {
+         if( g[j].same != (size_t) -1 || g[j].failed )
+            continue;
+         if( -1 == ( b = DupOpen( pool, &g[j], path ) ) )
+         {
+            g[j].failed = TRUE;
+            continue;
+         }
+         if( -1 == ( same = DupEqual( a, b, g[i].size, bufa, bufb ) ) )
+            g[j].failed = TRUE;
+         else if( same )
+            g[j].same = i;
+         close( b );
+      }
+      close( a );
+   }
+}
+
+void *DupWorker( void *arg )
+{
+   DupPool *pool = arg;
+   unsigned char *buf, *other = NULL;
+   PathBuf path;
+   DupFile *f;
+   size_t i;
+   int fd, ok;
+
+   buf = malloc( pool->stage == DUP_HEAD ? 2 * DUP_EDGE : DUP_READ );
+   if( pool->stage == DUP_BYTES )
+      other = malloc( DUP_READ );
+   if( buf == NULL || ( pool->stage == DUP_BYTES && other == NULL ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   PathInit( &path, "" );
+
+   while( ( i = __atomic_fetch_add( &pool->next, 1, __ATOMIC_RELAXED ) ) < pool->n )
+   {
+      f = pool->todo[i];
+      if( pool->stage == DUP_BYTES )
+      {
+         DupCompare( pool, f, &path, buf, other );
+         continue;
+      }
+      if( -1 == ( fd = DupOpen( pool, f, &path ) ) )
+      {
+         f->failed = TRUE;
+         continue;
+      }
+      ok = ( pool->stage == DUP_WHOLE ) ? DupWhole( fd, f, buf ) : DupHead( fd, f, buf );
+      if( !ok )
+         f->failed = TRUE;
+      close( fd );
+   }
+
+   free( path.buf );
+   free( other );
+   free( buf );
+   return( NULL );
+}
+
+/*
+        Read every file, or group, in `todo' on `threads' threads.
+*/
+
+void DupReadFiles( Dups *d, DupFile **todo, size_t n, int stage, int threads, char PathDelimiter )
+{
+   DupPool pool;
+   pthread_t *tids;
+   int i;
+
+   if( n == 0 )
+      return;
+   if( (size_t) threads > n )
+      threads = (int) n;
+
+   memset( &pool, 0, sizeof(pool) );
+   pool.dups          = d;
+   pool.todo          = todo;
+   pool.n             = n;
+   pool.stage         = stage;
+   pool.PathDelimiter = PathDelimiter;
+
+   if( NULL == ( tids = calloc( (size_t) threads, sizeof(pthread_t) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   for( i = 0; i < threads; i++ )
+   {
+      if( 0 != pthread_create( &tids[i], NULL, DupWorker, &pool ) )
+      {
+         perror("pthread_create:");
+         exit(1);
+      }
+   }
+   for( i = 0; i < threads; i++ )
+      pthread_join( tids[i], NULL );
+   free( tids );
+}
+
+/*
+        Largest first; then by hashes and bytes, so that matching files
+        lie side by side; then by inode, each inode's links by name.
+*/
+
+int CompareDups( const void *a, const void *b )
+{
+   const DupFile *x = a, *y = b;
+   int c;
+
+   if( x->size != y->size )
+      return( x->size < y->size ? 1 : -1 );
+   if( x->head != y->head )
+      return( x->head < y->head ? -1 : 1 );
+   if( x->hash != y->hash )
+      return( x->hash < y->hash ? -1 : 1 );
+   if( x->same != y->same )
+      return( x->same < y->same ? -1 : 1 );
+   if( x->dev != y->dev )
+      return( x->dev < y->dev ? -1 : 1 );
+   if( x->ino != y->ino )
+      return( x->ino < y->ino ? -1 : 1 );
+   if( 0 != ( c = strcmp( DupNames + x->dir, DupNames + y->dir ) ) )
+      return( c );
+   return( strcmp( DupNames + x->name, DupNames + y->name ) );
+}
+
+/*
+        Sort the list and keep only the runs of two or more files that
+        match so far, leaving out those that could not be read and, with
+        `links', all but the first name of each inode.
+*/
+
+size_t DupKeep( Dups *d, int links, unsigned long long *skipped )
+{
+   size_t i, j, k, n = 0;
+
+   DupNames = d->names.buf;
+   qsort( d->file, d->n, sizeof(DupFile), CompareDups );
+
+   for( i = 0; i < d->n; i = j )
+   {
+      for( j = i, k = n; j < d->n && SameDups( &d->file[i], &d->file[j] ); j++ )
+      {
+         if( d->file[j].failed )
+            continue;
+         if( links && k > n && d->file[k-1].dev == d->file[j].dev && d->file[k-1].ino == d->file[j].ino )
+         {
+            (*skipped)++;
+            continue;
+         }
+         d->file[ k++ ] = d->file[j];
+      }
+      if( k - n >= 2 )
+         n = k;
+   }
+
+   d->n = n;
+   return( n );
+}
+
+/*
+        Read one stage's files: for DUP_WHOLE only those too big to have
+        been read whole by DUP_HEAD, and for DUP_BYTES the first of each
+        group.
+*/
+
+void DupStage( Dups *d, int stage, int threads, char PathDelimiter )
+{
+   DupFile **todo;
+   size_t i, n = 0;
+
+   if( NULL == ( todo = malloc( ( d->n ? d->n : 1 ) * sizeof(DupFile *) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   for( i = 0; i < d->n; i++ )
+   {
+      if( stage == DUP_WHOLE && d->file[i].size <= 2 * DUP_EDGE )
+         continue;
+      if( stage == DUP_BYTES && i > 0 && SameDups( &d->file[ i - 1 ], &d->file[i] ) )
+         continue;
+      todo[ n++ ] = &d->file[i];
+   }
+
+   DupReadFiles( d, todo, n, stage, threads, PathDelimiter );
+   free( todo );
+}
+
+/*
+        Report the groups of copies, those wasting the most bytes first.
+*/
+
+typedef struct dupgroup{
+                         size_t              first;
+                         size_t              count;
+                         unsigned long long  wasted;
+
+                    } DupGroup;
+
+int CompareDupGroups( const void *a, const void *b )
+{
+   const DupGroup *x = a, *y = b;
+
+   if( x->wasted != y->wasted )
+      return( x->wasted < y->wasted ? 1 : -1 );
+   return( ( x->first > y->first ) - ( x->first < y->first ) );
+}
+
+void DupList( Scan *scan, Dups *d )
+{
+   DupGroup *group = NULL;
+   size_t groups = 0, groupsize = 0, i, j, k;
+   unsigned long long wasted = 0;
+   char a[32], b[32];
+   int unit;
+
+   for( i = 0; i < d->n; i = j )
+   {
+      for( j = i + 1; j < d->n && SameDups( &d->file[i], &d->file[j] ); j++ )
+         ;
+      Reserve( (char **) &group, &groupsize, ( groups + 1 ) * sizeof(DupGroup) );
+      group[ groups ].first  = i;
+      group[ groups ].count  = j - i;
+      group[ groups ].wasted = d->file[i].size * ( j - i - 1 );
+      wasted += group[ groups ].wasted;
+      groups++;
+   }
+   if( groups > 0 )
+      qsort( group, groups, sizeof(DupGroup), CompareDupGroups );
+
+   for( k = 0; k < groups; k++ )
+   {
+      DupFile *f = &d->file[ group[k].first ];
+
+      unit = UnitOf( (Counter) group[k].wasted, scan->Units );
+      printf( "%s %s wasted by %zu copies of ", FormatSize( (Counter) group[k].wasted, FALSE, FALSE, unit, a ),
+              UnitNames[ unit ], group[k].count );
+      unit = UnitOf( (Counter) f->size, scan->Units );
+      printf( "%s %s\n", FormatSize( (Counter) f->size, FALSE, FALSE, unit, b ), UnitNames[ unit ] );
+
+      for( i = 0; i < group[k].count; i++ )
+         printf( "          %s%c%s\n", d->names.buf + f[i].dir, scan->PathDelimiter, d->names.buf + f[i].name );
+   }
+
+   unit = UnitOf( (Counter) wasted, scan->Units );
+   printf( "%s %s wasted by duplicates in %zu groups\n",
+           FormatSize( (Counter) wasted, FALSE, FALSE, unit, a ), UnitNames[ unit ], groups );
+   free( group );
+}
+
+void FindDuplicates( Scan *scan, Reader *r )
+{
+   Dups *d = r->dups, none;
+   unsigned long long links = 0, sized, edged, hashed, whole = 0;
+   int threads = scan->Threads;
+   size_t i;
+
+   if( d == NULL )
+   {
+      memset( &none, 0, sizeof(none) );
+      d = &none;
+   }
+   if( threads <= 0 && ( threads = (int) sysconf( _SC_NPROCESSORS_ONLN ) ) <= 0 )
+      threads = 1;
+
+   sized = DupKeep( d, TRUE, &links );
+
+   DupStage( d, DUP_HEAD, threads, scan->PathDelimiter );
+   edged = DupKeep( d, FALSE, &links );
+
+   for( i = 0; i < d->n; i++ )
+      whole += ( d->file[i].size > 2 * DUP_EDGE );
+   DupStage( d, DUP_WHOLE, threads, scan->PathDelimiter );
+   hashed = DupKeep( d, FALSE, &links );
+
+   DupStage( d, DUP_BYTES, threads, scan->PathDelimiter );
+   DupKeep( d, FALSE, &links );
+
+   DupList( scan, d );
+
+   if( scan->ShowStats )
+      fprintf( stderr, "edu: duplicates: %llu files of a size seen twice, %llu after their ends, "
+                       "%llu read whole, %llu compared byte for byte, %llu hard links skipped\n",
+               sized, edged, whole, hashed, links );
+
+   free( d->file );
+   free( d->names.buf );
+   if( d != &none )
+      free( d );
+   r->dups = NULL;
+}
+
+#endif /* UNIX */
+
+/*
+  This is the main totalling engine.  This recursive procedure takes
+  a directory name, and will total all directories recursively. 
+
+  On UNIX the recursion is kept in a heap allocated stack of Frames rather
+  than on the C stack, so a deep tree costs one small Frame per level plus
+  the names still to be visited, and cannot overflow the stack.  Each
+  directory is opened relative to its parent's descriptor and each entry is
+  stat'ed relative to its own directory, so the kernel only ever looks up
+  one path component per call.  `path' holds the full name for printing
+  and error messages.
+
+  A lot of hacking had to be done for the Windows 95 environment with
+  Visual C++.  They just don't want you to be able to port a program
+  from some other environment.  I think people call it.... Proprietary.
+
+*/
+
+#ifdef UNIX
+
+typedef struct frame{
+                         int       fd;
+                         Total     total;
+                         Detail   *detail;      /* or NULL              */
+                         NameList  subdirs;     /* still to be visited  */
+                         size_t    next;        /* offset into subdirs  */
+                         size_t    pathlen;     /* path->len on entry   */
+
+                    } Frame;
+
+/*
+        Open directory `name' below `parentfd' and read it into a new Frame
+        on top of the stack.  Returns FALSE if it could not be opened.
+*/
+
+int PushFrame( Frame **stack, size_t *depth, size_t *size, int parentfd, char *name,
+               PathBuf *path, size_t pathlen, Reader *reader, Scan *scan )
+{
+   Frame *f;
+   SlowDir *slow;
+   struct stat statbuf;
+   unsigned long long start, ns;
+   int fd;
+
+          /* The starting directory may be a link, the ones below may not. */
+
+   start = StartCall( scan );
+   fd = openat( parentfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+                                ( *depth > 0 ? O_NOFOLLOW : 0 ) );
+   EndCall( scan, reader, CALL_OPEN, start );
+
+   if( fd == -1 )
+   {
+      fprintf(stderr,"Unable to open directory: %s\n", path->buf );
+      perror("opendir:");
+      return( FALSE );
+   }
+
+          /* /xdev: a mount point is left out, as if it were not there. */
+
+   if( scan->OneFilesystem && *depth > 0 && fstat( fd, &statbuf ) == 0 &&
+       (unsigned long long) statbuf.st_dev != scan->Device )
+   {
+      close( fd );
+      return( FALSE );
+   }
+
+   if( *depth == *size )
+   {
+      *size = *size ? *size * 2 : 64;
+      if( NULL == ( *stack = realloc( *stack, *size * sizeof(Frame) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+   }
+
+   f = &(*stack)[ (*depth)++ ];
+   memset( f, 0, sizeof(Frame) );
+   f->fd      = fd;
+   f->pathlen = pathlen;
+
+          /* Files first, then down into the subdirectories in order. */
+
+   f->detail = DirDetail( scan, reader );
+   if( scan->Duplicates )
+      DupDir( reader, path->buf );
+   ScanDirectory( scan, reader, fd, &f->total, &f->subdirs );
+   reader->Directories++;
+   if( !ShardCounts( scan, (int) *depth ) )
+      memset( &f->total, 0, sizeof(Total) );
+
+   if( scan->ShowStats && NULL != ( slow = SlowSlot( reader, ns = Now() - start ) ) )
+      SlowSet( slow, ns, path->buf );
+
+   return( TRUE );
+}
+
+Total DirectoryTotal( char *dirname, PathBuf *path, Reader *reader, Scan *scan )
+{
+   Frame *stack = NULL;
+   Frame *f;
+   unsigned long long start;
+   size_t depth = 0, size = 0;
+   size_t len;
+   char *subdir;
+
+   Total DirTotal = {0,0,0};
+
+   PushFrame( &stack, &depth, &size, AT_FDCWD, dirname, path, path->len, reader, scan );
+
+   while( depth > 0 )
+   {
+      f = &stack[ depth - 1 ];
+
+      if( f->next < f->subdirs.len )
+      {
+         subdir   = f->subdirs.buf + f->next;
+         f->next += strlen( subdir ) + 1;
+
+         if( scan->Shards > 0 && (int) depth + 1 == scan->ShardDepth &&
+             !ShardOwns( scan, path->buf + stack[0].pathlen, subdir ) )
+            continue;
+
+         len = path->len;
+         PathPush( path, scan->PathDelimiter, subdir );
+
+         if( !PushFrame( &stack, &depth, &size, f->fd, subdir, path, len, reader, scan ) )
+            PathPop( path, len );
+
+         continue;
+      }
+
+          /* All of its subdirectories are in, this directory is done. */
+
+      if( scan->total_only == FALSE )
+      {
+         if( (int) depth <= scan->RecursionLimit )
+         {
+            start = StartCall( scan );
+            ReportTotal( scan, &f->total, f->detail, path, (int) depth );
+            EndCall( scan, reader, CALL_OUTPUT, start );
+         }
+      }
+
+      start = StartCall( scan );
+      close( f->fd );
+      EndCall( scan, reader, CALL_CLOSE, start );
+      free( f->subdirs.buf );
+      PathPop( path, f->pathlen );
+
+      if( --depth > 0 )
+      {
+         AddTotal( &f->total, &stack[ depth - 1 ].total );
+         AddDetail( f->detail, stack[ depth - 1 ].detail );
+      }
+      else
+      {
+         DirTotal = f->total;
+         AddDetail( f->detail, &reader->tree );
+      }
+      FreeDetail( f->detail );
+   }
+
+   free( stack );
+
+   return ( DirTotal );
+}
+
+#else /* Windows 95 Specific, Damn you Microsoft! */
+
+Total DirectoryTotal( char *dirname, int total_only, char PathDelimiter, int RecursionLevel, int RecursionLimit, int Units )
+{
+  long   SearchHandle;
+  int    Status;
+  char   EffectivePath[_MAX_FNAME];
+  struct _finddata_t FileInfo;
+
+  char filespec[MAXPATHLEN];
+  char newdir[MAXPATHLEN];
+
+  Total DirTotal = {0,0,0};
+  Total TempTotal = {0,0,0};
+
+  sprintf( EffectivePath, "%s\\*.*", dirname );
+
+  SearchHandle = _findfirst( EffectivePath, &FileInfo );
+   
+  Status = SearchHandle;
+
+  while( Status != -1 )
+    {
+      if( FileInfo.attrib == _A_SUBDIR )
+        {
+          if( 0 != strcmp(FileInfo.name, ".") && 0 != strcmp(FileInfo.name, "..") )
+            {
+              sprintf(newdir,"%s%c%s", dirname, PathDelimiter, FileInfo.name );
+              
+              TempTotal = DirectoryTotal( newdir, total_only, PathDelimiter, RecursionLevel + 1, RecursionLimit, Units );
+              
+              AddTotal( &TempTotal, &DirTotal );
+            }
+        }
+      else 
+        {
+          DirTotal.Bytes += (Counter) FileInfo.size;
+          DirTotal.Files++;
+        }
+
+      Status = _findnext( SearchHandle, &FileInfo );
+
+      sprintf(filespec,"%-s%c%-s", dirname, PathDelimiter, FileInfo.name);
+      
+    }/*while*/
+
+  if( total_only == FALSE )
+  {
+     if( RecursionLevel  <= RecursionLimit )
+        PrintTotal( &DirTotal, SIZE_APPARENT, Units, dirname );
+  }
+
+  _findclose( SearchHandle );
+
+   return ( DirTotal );
+}
+
+#endif /* WIN95; UNIX */
+
+#ifdef UNIX
+
+/*
+  Parallel totalling engine (/threads=N).
+
+  Every directory found becomes a DirNode.  Worker threads take nodes from
+  their own deque, newest first so that a worker stays inside the subtree it
+  is working on, and steal the oldest node from another worker's deque when
+  their own runs dry.  The oldest nodes are the ones nearest the top of the
+  tree, so a steal usually takes a large piece of work.
+
+  A node is opened relative to its parent's descriptor, which is kept open
+  until the last of its children has been opened.  The worker that reads a
+  directory sums its files into the node's own Total.  When the last child
+  of a node finishes, the children's totals are merged into it and it is
+  marked done, which may in turn finish its parent.
+
+  With /device-threads=N each device has a group, and no more than N
+  workers read directories on one device at a time.  A node is in its
+  parent's group until it is opened and found to be on another device, at
+  a mount point, when it moves to that device's group.  A node that finds
+  its group full is parked there, and the worker that next leaves the
+  group reads it in its place.  So a slow network mount holds at most N
+  workers, and the rest go on with the other devices.
+
+  The main thread prints nodes in the same order as DirectoryTotal does
+  (children before parents, subdirectories in readdir order) by walking the
+  tree and waiting on each node as it reaches it.  Printed nodes are freed,
+  so the tree never holds much more than the part still being scanned.
+
+  With /dedupe-links the workers do not decide which name of a hard
+  linked file counts, as which got there first would depend on timing.
+  They hold such files back in the node, and the main thread settles them
+  as its walk reaches each node, parents before children, which is the
+  order DirectoryTotal reads them in: so the same name wins, and every
+  directory's total is the serial engine's.  What is settled is kept
+  apart from the totals the workers add up, and added in as nodes are
+  printed.
+*/
+
+#define NODE_QUEUED  0                  /* waiting for a worker         */
+#define NODE_READ    1                  /* children are all known       */
+#define NODE_DONE    2                  /* children are all totalled    */
+
+typedef struct dirnode{
+                         struct dirnode *parent;
+                         struct dirnode *child;      /* readdir order */
+                         struct dirnode *lastchild;
+                         struct dirnode *next;
+                         Total           total;
+                         Detail         *detail;     /* or NULL         */
+                         LinkList        links;      /* held back       */
+                         Total           linktotal;  /* settled links   */
+                         Detail         *linkdetail; /* of them, or NULL */
+                         int             level;
+                         int             pending;    /* children + self */
+                         int             state;
+                         int             failed;     /* opendir failed  */
+                         int             fd;         /* for children    */
+                         int             fdrefs;     /* unopened kids   */
+                         struct devgroup *group;     /* or NULL         */
+                         struct dirnode *parknext;   /* parked in group */
+                         int             hasslot;    /* given one       */
+                         char            name[1];    /* component       */
+
+                    } DirNode;
+
+typedef struct devgroup{
+                         unsigned long long dev;
+                         int             active;     /* workers in it   */
+                         DirNode        *parked;     /* oldest first    */
+                         DirNode        *lastparked;
+                         pthread_mutex_t lock;
+                         struct devgroup *next;
+
+                    } DevGroup;
+
+typedef struct deque{
+                         pthread_mutex_t lock;
+                         DirNode       **slot;       /* ring buffer     */
+                         size_t          size;
+                         size_t          head;       /* oldest, stolen  */
+                         size_t          tail;       /* newest, popped  */
+
+                    } Deque;
+
+typedef struct pool{
+                         int             Threads;
+                         Deque          *deques;
+                         Scan           *scan;
+                         int             queued;     /* nodes in deques */
+                         int             sleepers;
+                         int             done;
+                         pthread_mutex_t idlelock;
+                         pthread_cond_t  idlecond;
+                         DirNode        *waiting;    /* main waits here */
+                         pthread_mutex_t waitlock;
+                         pthread_cond_t  waitcond;
+                         DevGroup       *groups;     /* /device-threads */
+                         pthread_mutex_t grouplock;
+
+                    } Pool;
+
+typedef struct worker{
+                         Pool           *pool;
+                         int             id;
+                         unsigned int    seed;       /* victim choice   */
+                         char           *path;       /* scratch path    */
+                         size_t          pathsize;
+                         Reader          reader;
+                         NameList        subdirs;
+
+                    } Worker;
+
+/*
+        Allocate a node for directory `name' below `parent'.
+*/
+
+DirNode *NewNode( DirNode *parent, char *name, int level )
+{
+   DirNode *node;
+
+   if( NULL == ( node = calloc( 1, sizeof(DirNode) + strlen( name ) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   strcpy( node->name, name );
+   node->parent  = parent;
+   node->level   = level;
+   node->pending = 1;
+   node->fd      = -1;
+
+   return( node );
+}
+
+/*
+        Build the full path of a node into the worker's scratch buffer and
+        return its length.  Only needed for error messages and
+        /duplicates.
+*/
+
+size_t NodePath( Worker *w, DirNode *node )
+{
+   DirNode *n;
+   size_t   len = 0, pos;
+
+   for( n = node; n != NULL; n = n->parent )
+      len += strlen( n->name ) + 1;
+
+   Reserve( &w->path, &w->pathsize, len + 1 );
+
+   pos = len - 1;
+   w->path[ pos ] = 0;
+   for( n = node; n != NULL; n = n->parent )
+   {
+      size_t l = strlen( n->name );
+
+      pos -= l;
+      memcpy( w->path + pos, n->name, l );
+      if( pos > 0 )
+         w->path[ --pos ] = w->pool->scan->PathDelimiter;
+   }
+   return( len - 1 );
+}
+
+/*
+        Deque operations.  The owner pushes and pops at the tail, thieves
+        take from the head.
+*/
+
+void PushNode( Worker *w, DirNode *node )
+{
+   Pool  *pool = w->pool;
+   Deque *d    = &pool->deques[ w->id ];
+
+   pthread_mutex_lock( &d->lock );
+   if( d->tail - d->head == d->size )
+   {
+      size_t   newsize = d->size ? d->size * 2 : 64;
+      DirNode **slot   = malloc( newsize * sizeof(DirNode *) );
+      size_t   i;
+
+      if( slot == NULL )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      for( i = d->head; i != d->tail; i++ )
+         slot[ i % newsize ] = d->slot[ i % d->size ];
+      free( d->slot );
+      d->slot = slot;
+      d->size = newsize;
+   }
+   d->slot[ d->tail++ % d->size ] = node;
+   pthread_mutex_unlock( &d->lock );
+
+   __atomic_add_fetch( &pool->queued, 1, __ATOMIC_SEQ_CST );
+   if( __atomic_load_n( &pool->sleepers, __ATOMIC_SEQ_CST ) > 0 )
+   {
+      pthread_mutex_lock( &pool->idlelock );
+      pthread_cond_signal( &pool->idlecond );
+      pthread_mutex_unlock( &pool->idlelock );
+   }
+}
+
+DirNode *TakeNode( Pool *pool, int id, int steal )
+{
+   Deque   *d    = &pool->deques[ id ];
+   DirNode *node = NULL;
+
+   pthread_mutex_lock( &d->lock );
+   if( d->tail != d->head )
+   {
+      if( steal )
+         node = d->slot[ d->head++ % d->size ];
+      else
+         node = d->slot[ --d->tail % d->size ];
+   }
+   pthread_mutex_unlock( &d->lock );
+
+   if( node != NULL )
+      __atomic_sub_fetch( &pool->queued, 1, __ATOMIC_SEQ_CST );
+
+   return( node );
+}
+
+/*
+        Publish a node's new state, waking the main thread if it is waiting
+        on this node.
+*/
+
+void SetState( Pool *pool, DirNode *node, int state )
+{
+   __atomic_store_n( &node->state, state, __ATOMIC_SEQ_CST );
+
+   if( __atomic_load_n( &pool->waiting, __ATOMIC_SEQ_CST ) == node )
+   {
+      pthread_mutex_lock( &pool->waitlock );
+      pthread_cond_signal( &pool->waitcond );
+      pthread_mutex_unlock( &pool->waitlock );
+   }
+}
+
+void WaitState( Pool *pool, DirNode *node, int state )
+{
+   if( __atomic_load_n( &node->state, __ATOMIC_ACQUIRE ) >= state )
+      return;
+
+   pthread_mutex_lock( &pool->waitlock );
+   __atomic_store_n( &pool->waiting, node, __ATOMIC_SEQ_CST );
+   while( __atomic_load_n( &node->state, __ATOMIC_SEQ_CST ) < state )
+      pthread_cond_wait( &pool->waitcond, &pool->waitlock );
+   __atomic_store_n( &pool->waiting, NULL, __ATOMIC_SEQ_CST );
+   pthread_mutex_unlock( &pool->waitlock );
+}
+
+/*
+        Drop one reference on a node.  The last one merges the children's
+        totals into the node and passes the reference on to its parent.
+*/
+
+void FinishNode( Pool *pool, DirNode *node )
+{
+   DirNode *c;
+
+   while( node != NULL && __atomic_sub_fetch( &node->pending, 1, __ATOMIC_ACQ_REL ) == 0 )
+   {
+      for( c = node->child; c != NULL; c = c->next )
+      {
+         AddTotal( &c->total, &node->total );
+         AddDetail( c->detail, node->detail );
+      }
+
+      SetState( pool, node, NODE_DONE );
+
+      if( node->parent == NULL )
+      {
+         pthread_mutex_lock( &pool->idlelock );
+         pool->done = TRUE;
+         pthread_cond_broadcast( &pool->idlecond );
+         pthread_mutex_unlock( &pool->idlelock );
+      }
+      node = node->parent;
+   }
+}
+
+/*
+        Device groups (/device-threads).  FindGroup returns the group for a
+        device, making it the first time.  EnterGroup takes a slot in the
+        group for `node', or parks the node and returns FALSE.  LeaveGroup
+        gives the slot to the oldest parked node and returns it, or frees
+        the slot and returns NULL.
+*/
+
+DevGroup *FindGroup( Pool *pool, unsigned long long dev )
+{
+   DevGroup *g;
+
+   pthread_mutex_lock( &pool->grouplock );
+   for( g = pool->groups; g != NULL && g->dev != dev; g = g->next )
+      ;
+   if( g == NULL )
+   {
+      if( NULL == ( g = calloc( 1, sizeof(DevGroup) ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      g->dev = dev;
+      pthread_mutex_init( &g->lock, NULL );
+      g->next      = pool->groups;
+      pool->groups = g;
+   }
+   pthread_mutex_unlock( &pool->grouplock );
+   return( g );
+}
+
+int EnterGroup( DevGroup *g, DirNode *node, int limit )
+{
+   int entered;
+
+   pthread_mutex_lock( &g->lock );
+   if( ( entered = ( g->active < limit ) ) )
+      g->active++;
+   else
+   {
+      node->parknext = NULL;
+      if( g->lastparked != NULL )
+         g->lastparked->parknext = node;
+      else
+         g->parked = node;
+      g->lastparked = node;
+   }
+   pthread_mutex_unlock( &g->lock );
+   return( entered );
+}
+
+DirNode *LeaveGroup( DevGroup *g )
+{
+   DirNode *node;
+
+   pthread_mutex_lock( &g->lock );
+   if( NULL != ( node = g->parked ) )
+   {
+      if( NULL == ( g->parked = node->parknext ) )
+         g->lastparked = NULL;
+      node->hasslot = TRUE;
+   }
+   else
+      g->active--;
+   pthread_mutex_unlock( &g->lock );
+   return( node );
+}
+
+/*
+        A child has opened its directory; close the parent's descriptor
+        once no child needs it any more.
+*/
+
+void ReleaseFd( Worker *w, DirNode *node )
+{
+   unsigned long long start;
+
+   if( node != NULL && __atomic_sub_fetch( &node->fdrefs, 1, __ATOMIC_ACQ_REL ) == 0 )
+   {
+      start = StartCall( w->pool->scan );
+      close( node->fd );
+      EndCall( w->pool->scan, &w->reader, CALL_CLOSE, start );
+      node->fd = -1;
+   }
+}
+
+/*
+        Read one directory: total its files and queue its subdirectories.
+        Returns the parked node this worker's group slot was handed to,
+        which the worker reads next, or NULL.
+*/
+
+DirNode *ReadNode( Worker *w, DirNode *node )
+{
+   Scan *scan = w->pool->scan;
+   DevGroup *group = node->group;
+   DirNode *child, *next, *root;
+   SlowDir *slow;
+   struct stat statbuf;
+   unsigned long long start, ns;
+   char *subdir, *rel = NULL;
+   int fd;
+   int nchildren = 0, other = FALSE;
+
+   if( group != NULL && !node->hasslot && !EnterGroup( group, node, scan->DeviceThreads ) )
+      return( NULL );
+
+          /* A node parked at a mount point was opened already. */
+
+   start = StartCall( scan );
+   if( -1 == ( fd = node->fd ) )
+   {
+      fd = openat( node->parent ? node->parent->fd : AT_FDCWD, node->name,
+                   O_RDONLY | O_DIRECTORY | O_CLOEXEC | ( node->parent ? O_NOFOLLOW : 0 ) );
+      EndCall( scan, &w->reader, CALL_OPEN, start );
+
+      ReleaseFd( w, node->parent );
+
+      if( fd != -1 && ( scan->OneFilesystem || group != NULL ) && fstat( fd, &statbuf ) == 0 )
+         other = ( (unsigned long long) statbuf.st_dev != ( group != NULL ? group->dev : scan->Device ) );
+   }
+   node->fd = -1;
+
+   if( other && scan->OneFilesystem )
+   {
+          /* /xdev: a mount point is left out, as if it were not there. */
+
+      close( fd );
+      node->failed = TRUE;
+   }
+   else if( other )
+   {
+          /* Move to the new device's group, handing our slot on. */
+
+      node->fd      = fd;
+      node->hasslot = FALSE;
+      node->group   = FindGroup( w->pool, (unsigned long long) statbuf.st_dev );
+      if( NULL != ( next = LeaveGroup( group ) ) )
+         PushNode( w, next );
+      return( ReadNode( w, node ) );
+   }
+   else if( fd == -1 )
+   {
+      NodePath( w, node );
+      fprintf(stderr,"Unable to open directory: %s\n", w->path );
+      perror("opendir:");
+      node->failed = TRUE;
+   }
+   else
+   {
+      w->subdirs.len = 0;
+      node->detail = DirDetail( scan, &w->reader );
+      w->reader.deferred = ( scan->links != NULL ) ? &node->links : NULL;
+      if( scan->Duplicates )
+      {
+         NodePath( w, node );
+         DupDir( &w->reader, w->path );
+      }
+      ScanDirectory( scan, &w->reader, fd, &node->total, &w->subdirs );
+      w->reader.deferred = NULL;
+      w->reader.Directories++;
+      if( !ShardCounts( scan, node->level ) )
+         memset( &node->total, 0, sizeof(Total) );
+
+      if( scan->Shards > 0 && node->level + 1 == scan->ShardDepth )
+      {
+         for( root = node; root->parent != NULL; root = root->parent )
+            ;
+         NodePath( w, node );
+         rel = w->path + strlen( root->name );
+      }
+
+      for( subdir = w->subdirs.buf; subdir < w->subdirs.buf + w->subdirs.len; subdir += strlen( subdir ) + 1 )
+      {
+         if( rel != NULL && !ShardOwns( scan, rel, subdir ) )
+            continue;
+         child = NewNode( node, subdir, node->level + 1 );
+         child->group = group;
+         if( node->lastchild == NULL )
+            node->child = child;
+         else
+            node->lastchild->next = child;
+         node->lastchild = child;
+         nchildren++;
+      }
+
+      if( scan->ShowStats && NULL != ( slow = SlowSlot( &w->reader, ns = Now() - start ) ) )
+      {
+         NodePath( w, node );
+         SlowSet( slow, ns, w->path );
+      }
+
+          /* Keep the descriptor for the children to open themselves by. */
+
+      if( nchildren > 0 )
+         node->fd = fd;
+      else
+      {
+         start = StartCall( scan );
+         close( fd );
+         EndCall( scan, &w->reader, CALL_CLOSE, start );
+      }
+   }
+
+   node->fdrefs  = nchildren;
+   node->pending = nchildren + 1;
+
+   for( child = node->child; child != NULL; child = child->next )
+      PushNode( w, child );
+
+          /* The node may be freed once it is finished; leave first. */
+
+   next = ( group != NULL ) ? LeaveGroup( group ) : NULL;
+
+   SetState( w->pool, node, NODE_READ );
+   FinishNode( w->pool, node );
+
+   return( next );
+}
+
+/*
+        Read a node, then any parked node its slot was handed to.
+*/
+
+void ScanNode( Worker *w, DirNode *node )
+{
+   while( node != NULL )
+      node = ReadNode( w, node );
+}
+
+void *WorkerMain( void *arg )
+{
+   Worker  *w    = arg;
+   Pool    *pool = w->pool;
+   DirNode *node;
+   int      i;
+
+   for(;;)
+   {
+      node = TakeNode( pool, w->id, FALSE );
+
+      for( i = 1; node == NULL && i < pool->Threads; i++ )
+         node = TakeNode( pool, ( w->id + i + rand_r( &w->seed ) ) % pool->Threads, TRUE );
+
+      if( node != NULL )
+      {
+         ScanNode( w, node );
+         continue;
+      }
+
+      pthread_mutex_lock( &pool->idlelock );
+      __atomic_add_fetch( &pool->sleepers, 1, __ATOMIC_SEQ_CST );
+      if( !pool->done && __atomic_load_n( &pool->queued, __ATOMIC_SEQ_CST ) == 0 )
+         pthread_cond_wait( &pool->idlecond, &pool->idlelock );
+      __atomic_sub_fetch( &pool->sleepers, 1, __ATOMIC_SEQ_CST );
+      i = pool->done;
+      pthread_mutex_unlock( &pool->idlelock );
+
+      if( i )
+         break;
+   }
+   return( NULL );
+}
+
+/*
+        Print the tree in serial order, freeing it as it goes.  The walk
+        follows the nodes' own child, sibling and parent links, so it needs
+        no stack of its own.  `path' holds the root's path on entry.
+*/
+
+/*
+        Settle the links held back in a node, now that every node before
+        it in DirectoryTotal's order has been: the first name of an inode
+        counts, in the node's linktotal and linkdetail, and the others are
+        skipped.  Only the main thread touches these.
+*/
+
+void SettleLinks( Scan *scan, DirNode *node, Reader *r )
+{
+   FileInfo *fi;
+   size_t i;
+
+   for( i = 0; i < node->links.n; i++ )
+   {
+      fi = &node->links.fi[i];
+      if( LinkSeen( scan->links, fi->dev, fi->ino ) )
+      {
+         r->LinksSkipped++;
+         continue;
+      }
+      if( !ShardCounts( scan, node->level ) )
+         continue;
+
+      node->linktotal.Files++;
+      node->linktotal.Bytes     += (Counter) fi->size;
+      node->linktotal.Allocated += (Counter) fi->blocks * 512;
+
+      if( scan->Details == DETAIL_TREE )
+         DetailFile( scan, &r->tree, fi );
+      else if( scan->Details == DETAIL_DIRS )
+      {
+         if( node->linkdetail == NULL )
+            node->linkdetail = NewDetail( scan );
+         DetailFile( scan, node->linkdetail, fi );
+      }
+   }
+
+   free( node->links.fi );
+   memset( &node->links, 0, sizeof(LinkList) );
+}
+
+/*
+        Report a finished node with its settled links added in, and pass
+        them on to its parent.  The workers may still be reading the
+        node's own total and Detail, so they are added up in copies.
+*/
+
+void ReportNode( Scan *scan, DirNode *node, PathBuf *path, Reader *r )
+{
+   unsigned long long start;
+   Detail *detail = node->detail;
+   Total total = node->total;
+
+   AddTotal( &node->linktotal, &total );
+   if( node->linkdetail != NULL && detail != NULL )
+   {
+      detail = NewDetail( scan );
+      AddDetail( node->detail, detail );
+      AddDetail( node->linkdetail, detail );
+   }
+
+   if( scan->total_only == FALSE && node->failed == FALSE && node->level <= scan->RecursionLimit )
+   {
+      start = StartCall( scan );
+      ReportTotal( scan, &total, detail, path, node->level );
+      EndCall( scan, r, CALL_OUTPUT, start );
+   }
+
+   if( detail != node->detail )
+      FreeDetail( detail );
+   if( node->parent != NULL )
+   {
+      AddTotal( &node->linktotal, &node->parent->linktotal );
+      if( node->linkdetail != NULL )
+      {
+         if( node->parent->linkdetail == NULL )
+            node->parent->linkdetail = NewDetail( scan );
+         AddDetail( node->linkdetail, node->parent->linkdetail );
+      }
+   }
+}
+
+void EmitTree( Pool *pool, DirNode *root, PathBuf *path, Reader *r )
+{
+   Scan    *scan = pool->scan;
+   DirNode *node = root;
+   DirNode *c, *next;
+
+   for(;;)
+   {
+          /* Go down to the first directory with no subdirectories. */
+
+      WaitState( pool, node, NODE_READ );
+      SettleLinks( scan, node, r );
+      while( node->child != NULL )
+      {
+         node = node->child;
+         PathPush( path, scan->PathDelimiter, node->name );
+         WaitState( pool, node, NODE_READ );
+         SettleLinks( scan, node, r );
+      }
+
+          /* Print it, then go on to its next sibling or back up. */
+
+      for(;;)
+      {
+         WaitState( pool, node, NODE_DONE );
+         ReportNode( scan, node, path, r );
+
+         for( c = node->child; c != NULL; c = next )
+         {
+            next = c->next;
+            FreeDetail( c->detail );
+            FreeDetail( c->linkdetail );
+            free( c );
+         }
+         node->child = NULL;
+
+         if( node == root )
+            return;
+
+         PathPop( path, path->len - strlen( node->name ) - 1 );
+
+         if( node->next != NULL )
+         {
+            node = node->next;
+            PathPush( path, scan->PathDelimiter, node->name );
+            break;
+         }
+         node = node->parent;
+      }
+   }
+}
+
+/*
+        Every directory between the top and the one being read is held open,
+        so allow as many descriptors as the system will give us.
+*/
+
+void RaiseFileLimit( void )
+{
+   struct rlimit rl;
+
+   if( getrlimit( RLIMIT_NOFILE, &rl ) == 0 && rl.rlim_cur < rl.rlim_max )
+   {
+      rl.rlim_cur = rl.rlim_max;
+      setrlimit( RLIMIT_NOFILE, &rl );
+   }
+}
+
+Total ParallelDirectoryTotal( char *dirname, Scan *scan, Reader *counters )
+{
+   Pool       pool;
+   Worker    *workers;
+   pthread_t *tids;
+   DirNode   *root;
+   Total      DirTotal;
+   PathBuf    path;
+   int        Threads = scan->Threads;
+   int        i;
+
+   memset( &pool, 0, sizeof(pool) );
+   pool.Threads = Threads;
+   pool.scan    = scan;
+   pthread_mutex_init( &pool.idlelock, NULL );
+   pthread_cond_init( &pool.idlecond, NULL );
+   pthread_mutex_init( &pool.waitlock, NULL );
+   pthread_cond_init( &pool.waitcond, NULL );
+   pthread_mutex_init( &pool.grouplock, NULL );
+
+   pool.deques = calloc( Threads, sizeof(Deque) );
+   workers     = calloc( Threads, sizeof(Worker) );
+   tids        = calloc( Threads, sizeof(pthread_t) );
+   if( pool.deques == NULL || workers == NULL || tids == NULL )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+
+   for( i = 0; i < Threads; i++ )
+   {
+      pthread_mutex_init( &pool.deques[i].lock, NULL );
+      workers[i].pool = &pool;
+      workers[i].id   = i;
+      workers[i].seed = i + 1;
+   }
+
+   root = NewNode( NULL, dirname, 1 );
+   if( scan->DeviceThreads > 0 )
+      root->group = FindGroup( &pool, scan->Device );
+   PushNode( &workers[0], root );
+
+   for( i = 0; i < Threads; i++ )
+   {
+      if( 0 != pthread_create( &tids[i], NULL, WorkerMain, &workers[i] ) )
+      {
+         perror("pthread_create:");
+         exit(1);
+      }
+   }
+
+   PathInit( &path, dirname );
+   EmitTree( &pool, root, &path, counters );
+
+   for( i = 0; i < Threads; i++ )
+   {
+      pthread_join( tids[i], NULL );
+      free( workers[i].path );
+      free( workers[i].reader.buf );
+      free( workers[i].reader.window );
+      free( workers[i].reader.names );
+#ifdef HAVE_URING
+      UringClose( workers[i].reader.ring );
+#endif
+      free( workers[i].subdirs.buf );
+      AddCounters( counters, &workers[i].reader );
+      free( pool.deques[i].slot );
+      pthread_mutex_destroy( &pool.deques[i].lock );
+   }
+
+   DirTotal = root->total;
+   AddTotal( &root->linktotal, &DirTotal );
+   AddDetail( root->detail, &counters->tree );
+   AddDetail( root->linkdetail, &counters->tree );
+   FreeDetail( root->detail );
+   FreeDetail( root->linkdetail );
+
+   while( pool.groups != NULL )
+   {
+      DevGroup *g = pool.groups;
+
+      pool.groups = g->next;
+      pthread_mutex_destroy( &g->lock );
+      free( g );
+   }
+
+   free( root );
+   free( path.buf );
+   free( tids );
+   free( workers );
+   free( pool.deques );
+
+   return ( DirTotal );
+}
+
+#endif /* UNIX */
+
+#ifdef __linux__
+
+/*
+  Watch mode (/watch[=SECONDS]).
+
+  After one scan of the tree, which is printed as usual, the tree is kept in
+  memory as WatchNodes, each with the sum of the files directly in it and
+  the total of its whole subtree, and every directory is watched with
+  inotify.  An event only marks its directory dirty.  Every interval each
+  dirty directory is read again: its file sum is recomputed, subdirectories
+  that appeared are scanned and watched, and ones that went away are
+  dropped.  The difference is carried up through its ancestors, and every
+  directory whose total moved since the last report is printed with the
+  change, children before parents.
+
+  inotify is used rather than fanotify because fanotify's directory events
+  need CAP_SYS_ADMIN, and edu is normally run by the owner of the tree.
+*/
+
+/*
+        No IN_DONT_FOLLOW: watches are added through /proc/self/fd links to
+        directories that were opened with O_NOFOLLOW already.
+*/
+
+#define WATCH_MASK  ( IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | \
+                      IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK )
+
+typedef struct watchnode{
+                         struct watchnode *parent;
+                         struct watchnode *child;
+                         struct watchnode *next;
+                         long long         own;        /* files in it      */
+                         long long         total;      /* whole subtree    */
+                         long long         reported;   /* total last shown */
+                         int               wd;         /* inotify, or -1   */
+                         int               level;
+                         int               dirty;      /* read it again    */
+                         int               changed;    /* print it         */
+                         char              name[1];
+
+                    } WatchNode;
+
+typedef struct watch{
+                         Scan             *scan;
+                         int               ifd;        /* inotify          */
+                         WatchNode        *root;
+                         WatchNode       **bywd;       /* wd -> node       */
+                         size_t            bywdsize;
+                         WatchNode       **dirty;      /* to read again    */
+                         size_t            ndirty;
+                         size_t            done;       /* of this round    */
+                         size_t            dirtysize;
+                         Reader            reader;
+                         NameList          names;
+                         PathBuf           path;
+
+                    } Watch;
+
+WatchNode *NewWatchNode( WatchNode *parent, char *name )
+{
+   WatchNode *node;
+
+   if( NULL == ( node = calloc( 1, sizeof(WatchNode) + strlen( name ) ) ) )
+   {
+      fprintf(stderr,"edu: Out of memory.\n");
+      exit(1);
+   }
+   strcpy( node->name, name );
+   node->parent = parent;
+   node->level  = parent ? parent->level + 1 : 1;
+   node->wd     = -1;
+   return( node );
+}
+
+/*
+        Put the full path of a node in w->path.
+*/
+
+void WatchPath( Watch *w, WatchNode *node )
+{
+   WatchNode *n;
+   size_t len = 0, pos, l;
+
+   for( n = node; n != NULL; n = n->parent )
+      len += strlen( n->name ) + 1;
+
+   Reserve( &w->path.buf, &w->path.size, len );
+   w->path.len = pos = len - 1;
+   w->path.buf[ pos ] = 0;
+
+   for( n = node; n != NULL; n = n->parent )
+   {
+      l = strlen( n->name );
+      pos -= l;
+      memcpy( w->path.buf + pos, n->name, l );
+      if( pos > 0 )
+         w->path.buf[ --pos ] = w->scan->PathDelimiter;
+   }
+}
+
+/*
+        Watch the open directory `fd' for `node'.  The watch is added through
+        /proc/self/fd so that the path is not looked up again.
+*/
+
+void AddWatch( Watch *w, WatchNode *node, int fd )
+{
+   char procpath[64];
+   size_t n, size;
+   int wd;
+
+   sprintf( procpath, "/proc/self/fd/%d", fd );
+   if( -1 == ( wd = inotify_add_watch( w->ifd, procpath, WATCH_MASK ) ) )
+   {
+      fprintf(stderr,"Unable to watch directory: %s\n", w->path.buf );
+      perror("inotify_add_watch:");
+      return;
+   }
+
+   n    = w->bywdsize / sizeof(WatchNode *);
+   size = w->bywdsize;
+   Reserve( (char **) &w->bywd, &w->bywdsize, ( wd + 1 ) * sizeof(WatchNode *) );
+   memset( (char *) w->bywd + size, 0, w->bywdsize - size );
+
+          /* A directory moved within the tree keeps its watch. */
+
+   if( (size_t) wd < n && w->bywd[ wd ] != NULL )
+      w->bywd[ wd ]->wd = -1;
+
+   w->bywd[ wd ] = node;
+   node->wd      = wd;
+}
+
+/*
+        Remember that a directory has to be read again.
+*/
+
+void MarkDirty( Watch *w, WatchNode *node )
+{
+   if( node == NULL || node->dirty )
+      return;
+
+   node->dirty = TRUE;
+   Reserve( (char **) &w->dirty, &w->dirtysize, ( w->ndirty + 1 ) * sizeof(WatchNode *) );
+   w->dirty[ w->ndirty++ ] = node;
+}
+
+/*
+        Read the open directory `fd' into `node': its file sum, its watch,
+        and a new child node for each subdirectory.
+*/
+
+void ReadWatchNode( Watch *w, WatchNode *node, int fd )
+{
+   Total own = {0,0,0};
+   WatchNode *child, *last = NULL;
+   char *subdir;
+
+   w->names.len = 0;
+   ReadDirectory( w->scan, &w->reader, fd, &own, &w->names );
+
+   node->own     = TotalBytes( &own, w->scan->Sizes );
+   node->total   = node->own;
+   node->changed = TRUE;
+   AddWatch( w, node, fd );
+
+   for( subdir = w->names.buf; subdir < w->names.buf + w->names.len; subdir += strlen( subdir ) + 1 )
+   {
+      child = NewWatchNode( node, subdir );
+      if( last == NULL )
+         node->child = child;
+      else
+         last->next = child;
+      last = child;
+   }
+}
+
+/*
+        Drop a subtree, removing its watches.
+*/
+
+void FreeWatchTree( Watch *w, WatchNode *node )
+{
+   WatchNode *top = node, *up;
+   size_t i;
+
+   while( node != NULL )
+   {
+      if( node->child != NULL )
+      {
+         node = node->child;
+         continue;
+      }
+
+      if( node->wd >= 0 && w->bywd[ node->wd ] == node )
+      {
+         inotify_rm_watch( w->ifd, node->wd );
+         w->bywd[ node->wd ] = NULL;
+      }
+      if( node->dirty )
+      {
+         for( i = 0; i < w->ndirty; i++ )
+            if( w->dirty[i] == node )
+               w->dirty[i] = NULL;
+      }
+
+      up = ( node == top ) ? NULL : node->parent;
+      if( up != NULL )
+         up->child = node->next;
+      free( node );
+      node = up;
+   }
+}
+
+/*
+        Scan the directory `top', already linked into the tree with its path
+        in w->path, and everything below it, with the same explicit stack
+        walk as DirectoryTotal.  Subdirectories that cannot be opened are
+        dropped.  Returns FALSE if `top' itself could not be opened.
+*/
+
+typedef struct watchframe{
+                         WatchNode *node;
+                         WatchNode *next;         /* child to visit next */
+                         int        fd;
+                         size_t     pathlen;
+
+                    } WatchFrame;
+
+int ScanWatchTree( Watch *w, int parentfd, WatchNode *top )
+{
+   WatchFrame *stack = NULL;
+   WatchFrame *f;
+   size_t depth = 0, size = 0;
+   WatchNode *node = top, **link;
+   size_t pathlen = w->path.len;
+   int fd;
+
+   while( node != NULL )
+   {
+      fd = openat( parentfd, node->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+                                         ( node->level > 1 ? O_NOFOLLOW : 0 ) );
+      if( fd == -1 )
+      {
+         fprintf(stderr,"Unable to open directory: %s\n", w->path.buf );
+         perror("opendir:");
+         PathPop( &w->path, pathlen );
+
+         if( node == top )
+            break;
+
+         for( link = &node->parent->child; *link != node; link = &(*link)->next )
+            ;
+         *link = node->next;
+         free( node );
+      }
+      else
+      {
+         ReadWatchNode( w, node, fd );
+
+         Reserve( (char **) &stack, &size, ( depth + 1 ) * sizeof(WatchFrame) );
+         f = &stack[ depth++ ];
+         f->node    = node;
+         f->next    = node->child;
+         f->fd      = fd;
+         f->pathlen = pathlen;
+      }
+
+          /* Next subdirectory to open, finishing directories on the way up. */
+
+      node = NULL;
+      while( depth > 0 && node == NULL )
+      {
+         f = &stack[ depth - 1 ];
+         if( f->next != NULL )
+         {
+            node     = f->next;
+            f->next  = node->next;
+            parentfd = f->fd;
+            pathlen  = w->path.len;
+            PathPush( &w->path, w->scan->PathDelimiter, node->name );
+         }
+         else
+         {
+            close( f->fd );
+            PathPop( &w->path, f->pathlen );
+            if( f->node != top )
+               f->node->parent->total += f->node->total;
+            depth--;
+         }
+      }
+   }
+
+   free( stack );
+
+   return( top->changed );
+}
+
+int CompareNames( const void *a, const void *b )
+{
+   return( strcmp( *(char **) a, *(char **) b ) );
+}
+
+/*
+        Read a dirty directory again and bring its node up to date.
+*/
+
+void RescanWatchNode( Watch *w, WatchNode *node )
+{
+   Total own = {0,0,0};
+   WatchNode *c, **link;
+   char **names = NULL, **kids = NULL, *subdir;
+   size_t nnames = 0, nkids = 0, namesize = 0, kidsize = 0, len;
+   long long before = node->total;
+   int fd;
+
+   WatchPath( w, node );
+
+   if( -1 == ( fd = open( w->path.buf, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW ) ) )
+      return;           /* gone; its parent has an event of its own */
+
+   w->names.len = 0;
+   ReadDirectory( w->scan, &w->reader, fd, &own, &w->names );
+
+   node->total += TotalBytes( &own, w->scan->Sizes ) - node->own;
+   node->own    = TotalBytes( &own, w->scan->Sizes );
+
+          /* Drop the children that went away... */
+
+   for( subdir = w->names.buf; subdir < w->names.buf + w->names.len; subdir += strlen( subdir ) + 1 )
+   {
+      Reserve( (char **) &names, &namesize, ( nnames + 1 ) * sizeof(char *) );
+      names[ nnames++ ] = subdir;
+   }
+   qsort( names, nnames, sizeof(char *), CompareNames );
+
+   for( link = &node->child; ( c = *link ) != NULL; )
+   {
+      subdir = c->name;
+      if( nnames == 0 || NULL == bsearch( &subdir, names, nnames, sizeof(char *), CompareNames ) )
+      {
+         node->total -= c->total;
+         *link   = c->next;
+         c->next = NULL;
+         FreeWatchTree( w, c );
+      }
+      else
+      {
+         Reserve( (char **) &kids, &kidsize, ( nkids + 1 ) * sizeof(char *) );
+         kids[ nkids++ ] = c->name;
+         link = &c->next;
+      }
+   }
+   qsort( kids, nkids, sizeof(char *), CompareNames );
+
+          /* ...and scan the new ones, in readdir order. */
+
+   for( subdir = w->names.buf; subdir < w->names.buf + w->names.len; subdir += strlen( subdir ) + 1 )
+   {
+      if( nkids > 0 && NULL != bsearch( &subdir, kids, nkids, sizeof(char *), CompareNames ) )
+         continue;
+
+      c = NewWatchNode( node, subdir );
+      *link = c;
+
+      len = w->path.len;
+      PathPush( &w->path, w->scan->PathDelimiter, subdir );
+      if( ScanWatchTree( w, fd, c ) )
+      {
+         node->total += c->total;
+         link = &c->next;
+      }
+      else
+      {
+         *link = NULL;
+         free( c );
+      }
+      PathPop( &w->path, len );
+   }
+
+   close( fd );
+   free( names );
+   free( kids );
+
+   node->changed = TRUE;
+   for( c = node->parent; c != NULL; c = c->parent )
+   {
+      c->total  += node->total - before;
+      c->changed = TRUE;
+   }
+}
+
+/*
+        Print, children before parents, every directory whose total changed
+        since it was last printed.  The first time round (`all') print the
+        whole tree the usual way.
+*/
+
+WatchNode *NextToPrint( WatchNode *c, int all )
+{
+   while( c != NULL && !( all || c->changed ) )
+      c = c->next;
+   return( c );
+}
+
+void PrintWatchTree( Watch *w, int all )
+{
+   Scan *scan = w->scan;
+   WatchNode *node = w->root, *c;
+   Total t;
+
+   WatchPath( w, node );
+
+   for(;;)
+   {
+      while( NULL != ( c = NextToPrint( node->child, all ) ) )
+      {
+         node = c;
+         PathPush( &w->path, scan->PathDelimiter, node->name );
+      }
+
+      for(;;)
+      {
+         if( scan->total_only == FALSE && node->level <= scan->RecursionLimit )
+         {
+            if( all )
+            {
+               t.Bytes = t.Allocated = (Counter) node->total;
+               PrintTotal( &t, scan->Sizes, scan->Units, w->path.buf );
+            }
+            else if( node->total != node->reported )
+            {
+               PrintChange( node->total - node->reported, scan->Units );
+               printf( " in %-s\n", w->path.buf );
+            }
+         }
+         else if( scan->total_only && node == w->root && !all && node->total != node->reported )
+         {
+            PrintChange( node->total - node->reported, scan->Units );
+            printf( "\n" );
+         }
+         node->reported = node->total;
+         node->changed  = FALSE;
+
+         if( node == w->root )
+         {
+            fflush( stdout );
+            return;
+         }
+
+         PathPop( &w->path, w->path.len - strlen( node->name ) - 1 );
+
+         if( NULL != ( c = NextToPrint( node->next, all ) ) )
+         {
+            node = c;
+            PathPush( &w->path, scan->PathDelimiter, node->name );
+            break;
+         }
+         node = node->parent;
+      }
+   }
+}
+
+int CompareLevels( const void *a, const void *b )
+{
+   WatchNode *na = *(WatchNode **) a, *nb = *(WatchNode **) b;
+
+   return( ( na ? na->level : 0 ) - ( nb ? nb->level : 0 ) );
+}
+
+/*
+        Start watching: scan the tree into memory, every directory watched.
+*/
+
+void WatchInit( Watch *w, char *dirname, Scan *scan )
+{
+   memset( w, 0, sizeof(Watch) );
+   w->scan = scan;
+
+   if( -1 == ( w->ifd = inotify_init1( IN_CLOEXEC ) ) )
+   {
+      perror("inotify_init1:");
+      exit(1);
+   }
+
+   w->root = NewWatchNode( NULL, dirname );
+   PathInit( &w->path, dirname );
+   if( !ScanWatchTree( w, AT_FDCWD, w->root ) )
+      exit(1);
+}
+
+/*
+        Read the waiting inotify events and mark their directories dirty.
+*/
+
+void WatchEvents( Watch *w )
+{
+   char events[ 64 * 1024 ];
+   struct inotify_event *ev;
+   WatchNode *node;
+   ssize_t n;
+   size_t i;
+   char *p;
+
+   if( ( n = read( w->ifd, events, sizeof(events) ) ) <= 0 )
+      return;
+
+   for( p = events; p < events + n; p += sizeof(struct inotify_event) + ev->len )
+   {
+      ev = (struct inotify_event *) p;
+
+      if( ev->mask & IN_Q_OVERFLOW )
+      {
+         for( i = 0; i < w->bywdsize / sizeof(WatchNode *); i++ )
+            MarkDirty( w, w->bywd[i] );
+         continue;
+      }
+      if( ev->wd < 0 || (size_t) ev->wd >= w->bywdsize / sizeof(WatchNode *) ||
+          NULL == ( node = w->bywd[ ev->wd ] ) )
+         continue;
+
+      if( ev->mask & IN_IGNORED )
+      {
+         node->wd = -1;
+         w->bywd[ ev->wd ] = NULL;
+      }
+      else if( ev->mask & IN_DELETE_SELF )
+      {
+         if( node == w->root )
+         {
+            fprintf(stderr,"edu: %s was removed.\n", w->root->name );
+            exit(0);
+         }
+         MarkDirty( w, node->parent );
+      }
+      else
+      {
+         MarkDirty( w, node );
+      }
+   }
+}
+
+/*
+        Read up to `max' dirty directories again, parents first so dropped
+        subtrees are not read.  Directories marked while a round is under
+        way join the end of it.  Returns TRUE if the round is not done.
+*/
+
+int WatchRescan( Watch *w, size_t max )
+{
+   WatchNode *node;
+
+   if( w->done == 0 && w->ndirty > 0 )
+      qsort( w->dirty, w->ndirty, sizeof(WatchNode *), CompareLevels );
+
+   for( ; w->done < w->ndirty && max > 0; w->done++, max-- )
+   {
+      if( NULL != ( node = w->dirty[ w->done ] ) )
+      {
+         node->dirty = FALSE;
+         RescanWatchNode( w, node );
+      }
+   }
+
+   if( w->done < w->ndirty )
+      return( TRUE );
+   w->ndirty = w->done = 0;
+   return( FALSE );
+}
+
+/*
+        Scan the tree, then follow it until killed.
+*/
+
+void WatchDirectory( char *dirname, Scan *scan, int Interval )
+{
+   Watch w;
+   struct pollfd pfd;
+   struct timespec now;
+   double next, left;
+
+   WatchInit( &w, dirname, scan );
+
+   PrintWatchTree( &w, TRUE );
+   if( scan->total_only )
+   {
+      Total t;
+
+      t.Bytes = t.Allocated = (Counter) w.root->total;
+      PrintTotal( &t, scan->Sizes, scan->Units, NULL );
+   }
+   fflush( stdout );
+
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   next = now.tv_sec + now.tv_nsec / 1e9 + Interval;
+
+   for(;;)
+   {
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      left = next - ( now.tv_sec + now.tv_nsec / 1e9 );
+
+      pfd.fd     = w.ifd;
+      pfd.events = POLLIN;
+      if( left > 0 && poll( &pfd, 1, (int)( left * 1000 ) + 1 ) > 0 )
+      {
+         WatchEvents( &w );
+         continue;
+      }
+
+          /* Interval is up. */
+
+      WatchRescan( &w, (size_t) -1 );
+
+      if( w.root->changed )
+         PrintWatchTree( &w, FALSE );
+
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      next = now.tv_sec + now.tv_nsec / 1e9 + Interval;
+   }
+}
+
+/*
+  Serve mode (/serve=SOCKET).
+
+  The tree is scanned once into WatchNodes and kept up to date as with
+  /watch, but nothing is printed: edu listens on a Unix domain socket and
+  answers questions about the tree from memory instead.  Directories
+  marked dirty by inotify are read again every SERVE_BATCH seconds, and
+  with /refresh=SECONDS the whole tree is marked dirty every SECONDS as
+  well, to pick up changes inotify cannot see, such as those made by other
+  hosts on a shared mount.  Either way the reading is done SERVE_SLICE
+  directories at a time between questions, so an answer never waits for
+  more than a slice.
+
+  A question is one line, and the answer is zero or more lines of
+  "BYTES PATH", exact sizes as /allocated or not chosen for the server,
+  after which the server closes the connection:
+
+        total PATH         PATH's own total
+        children PATH      its subdirectories, largest first
+        top N PATH         the N largest of it and the directories below
+
+  PATH is as edu prints it, starting with the dirname being served; an
+  empty PATH is the dirname.  A question that cannot be answered gets the
+  one line "error: WHY".  /query=SOCKET asks a server and prints the
+  answer the usual way.
+*/
+
+#define SERVE_BATCH           1         /* seconds */
+#define SERVE_SLICE           64        /* directories read between polls */
+#define SERVE_QUESTION        8192
+
+static volatile sig_atomic_t ServeStop;
+
+void ServeSignal( int sig )
+{
+   (void) sig;
+   ServeStop = TRUE;
+}
+
+/*
+        The next name in `p' and its length, past any delimiters and `.'
+        names, or NULL at the end.
+*/
+
+char *PathComponent( char *p, char PathDelimiter, size_t *len )
+{
+   for(;;)
+   {
+      while( *p == PathDelimiter )
+         p++;
+      if( *p == 0 )
+         return( NULL );
+      for( *len = 0; p[ *len ] != 0 && p[ *len ] != PathDelimiter; (*len)++ )
+         ;
+      if( *len != 1 || p[0] != '.' )
+         return( p );
+      p++;
+   }
+}
+
+/*
+        Find the node for `path', or NULL.  Repeated delimiters and `.'
+        names are passed over, in `path' and in the served dirname alike,
+        so t2/, ./t2 and t2//./x find what t2 and t2/x do.
+*/
+
+WatchNode *FindWatchNode( Watch *w, char *path )
+{
+   WatchNode *node = w->root;
+   char delim = w->scan->PathDelimiter, *p = path, *r;
+   size_t l, rl;
+
+   if( *path == 0 )
+      return( node );
+   if( ( path[0] == delim ) != ( node->name[0] == delim ) )
+      return( NULL );
+
+          /* Past the served dirname first, then down its children. */
+
+   for( r = node->name; NULL != ( r = PathComponent( r, delim, &rl ) ); r += rl, p += l )
+      if( NULL == ( p = PathComponent( p, delim, &l ) ) || l != rl || 0 != strncmp( p, r, l ) )
+         return( NULL );
+
+   for( ; node != NULL && NULL != ( p = PathComponent( p, delim, &l ) ); p += l )
+   {
+      for( node = node->child; node != NULL; node = node->next )
+         if( 0 == strncmp( node->name, p, l ) && node->name[ l ] == 0 )
+            break;
+   }
+   return( node );
+}
+
+/*
+        Add "BYTES PATH" for `node' to the answer.
+*/
+
+void ServeLine( Watch *w, NameList *out, WatchNode *node )
+{
+   char number[32];
+   size_t n;
+
+   WatchPath( w, node );
+   n = (size_t) sprintf( number, "%lld ", node->total );
+   Reserve( &out->buf, &out->size, out->len + n + w->path.len + 2 );
+   memcpy( out->buf + out->len, number, n );
+   memcpy( out->buf + out->len + n, w->path.buf, w->path.len );
+   out->len += n + w->path.len;
+   out->buf[ out->len++ ] = '\n';
+}
+
+int CompareWatchTotals( const void *a, const void *b )
+{
+   WatchNode *x = *(WatchNode **) a, *y = *(WatchNode **) b;
+
+   if( x->total != y->total )
+      return( x->total < y->total ? 1 : -1 );
+   return( strcmp( x->name, y->name ) );
+}
+
+/*
+        The N largest directories of `top' and those below it, as /top
+        ranks a scan: a min heap of N nodes, filled on one walk of the
+        subtree, then sorted.
+*/
+
+size_t TopWatchNodes( WatchNode *top, WatchNode ***heap, size_t *size, size_t max )
+{
+   WatchNode *node = top;
+   size_t n = 0, i, c;
+
+   while( node != NULL && max > 0 )
+   {
+      if( n < max || node->total > (*heap)[0]->total )
+      {
+         if( n < max )
+         {
+            Reserve( (char **) heap, size, ( n + 1 ) * sizeof(WatchNode *) );
+            for( i = n++; i > 0 && (*heap)[ ( i - 1 ) / 2 ]->total > node->total; i = ( i - 1 ) / 2 )
+               (*heap)[i] = (*heap)[ ( i - 1 ) / 2 ];
+            (*heap)[i] = node;
+         }
+         else
+         {
+            for( i = 0; ( c = 2 * i + 1 ) < n; i = c )
+            {
+               if( c + 1 < n && (*heap)[ c + 1 ]->total < (*heap)[c]->total )
+                  c++;
+               if( (*heap)[c]->total >= node->total )
+                  break;
+               (*heap)[i] = (*heap)[c];
+            }
+            (*heap)[i] = node;
+         }
+      }
+
+          /* Depth first, never above `top'. */
+
+      if( node->child != NULL )
+         node = node->child;
+      else
+      {
+         while( node != top && node->next == NULL )
+            node = node->parent;
+         node = ( node == top ) ? NULL : node->next;
+      }
+   }
+
+   qsort( *heap, n, sizeof(WatchNode *), CompareWatchTotals );
+   return( n );
+}
+
+/*
+        Answer one question on a new connection, then close it.
+*/
+
+void ServeClient( Watch *w, int lfd, NameList *out, WatchNode ***list, size_t *listsize )
+{
+   char question[ SERVE_QUESTION ], *path, *p;
+   struct timeval timeout = { 1, 0 };
+   WatchNode *node, *c;
+   size_t len = 0, n, i;
+   ssize_t got;
+   long count = 0;
+   int fd;
+
+   if( -1 == ( fd = accept4( lfd, NULL, NULL, SOCK_CLOEXEC ) ) )
+      return;
+   setsockopt( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+   setsockopt( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout) );
+
+   while( len < sizeof(question) - 1 && NULL == memchr( question, '\n', len ) &&
+          0 < ( got = read( fd, question + len, sizeof(question) - 1 - len ) ) )
+      len += (size_t) got;
+   question[ len ] = 0;
+   if( NULL != ( p = strchr( question, '\n' ) ) )
+      *p = 0;
+
+   out->len = 0;
+   if( NULL == ( path = strchr( question, ' ' ) ) )
+      path = question + strlen( question );
+   else
+      *path++ = 0;
+
+   if( 0 == strcmp( question, "top" ) )
+   {
+      count = strtol( path, &p, 10 );
+      path  = ( *p == ' ' ) ? p + 1 : p;
+   }
+
+   if( 0 != strcmp( question, "total" ) && 0 != strcmp( question, "children" ) &&
+       ( 0 != strcmp( question, "top" ) || count <= 0 ) )
+      NameAdd( out, "error: Unknown question." );
+   else if( NULL == ( node = FindWatchNode( w, path ) ) )
+      NameAdd( out, "error: No such directory." );
+   else if( 0 == strcmp( question, "total" ) )
+      ServeLine( w, out, node );
+   else if( 0 == strcmp( question, "children" ) )
+   {
+      for( n = 0, c = node->child; c != NULL; c = c->next )
+      {
+         Reserve( (char **) list, listsize, ( n + 1 ) * sizeof(WatchNode *) );
+         (*list)[ n++ ] = c;
+      }
+      qsort( *list, n, sizeof(WatchNode *), CompareWatchTotals );
+      for( i = 0; i < n; i++ )
+         ServeLine( w, out, (*list)[i] );
+   }
+   else
+   {
+      n = TopWatchNodes( node, list, listsize, (size_t) count );
+      for( i = 0; i < n; i++ )
+         ServeLine( w, out, (*list)[i] );
+   }
+
+          /* NameAdd ends an error with a NUL; a line ends with '\n'. */
+
+   if( out->len > 0 && out->buf[ out->len - 1 ] == 0 )
+      out->buf[ out->len - 1 ] = '\n';
+
+   for( p = out->buf; p < out->buf + out->len; p += got )
+      if( 0 >= ( got = send( fd, p, (size_t)( out->buf + out->len - p ), MSG_NOSIGNAL ) ) )
+         break;
+   close( fd );
+}
+
+/*
+        Mark every directory of the tree dirty, for /refresh.
+*/
+
+void MarkTreeDirty( Watch *w )
+{
+   WatchNode *node = w->root;
+
+   while( node != NULL )
+   {
+      MarkDirty( w, node );
+      if( node->child != NULL )
+         node = node->child;
+      else
+      {
+         while( node != NULL && node->next == NULL )
+            node = node->parent;
+         if( node != NULL )
+            node = node->next;
+      }
+   }
+}
+
+int ServeListen( char *name )
+{
+   struct sockaddr_un addr;
+   struct stat statbuf;
+   int fd;
+
+   memset( &addr, 0, sizeof(addr) );
+   addr.sun_family = AF_UNIX;
+   if( strlen( name ) >= sizeof(addr.sun_path) )
+   {
+      fprintf(stderr,"edu: The socket name %s is too long.\n", name );
+      exit(1);
+   }
+   strcpy( addr.sun_path, name );
+
+          /* A socket left by an earlier server is replaced, nothing else. */
+
+   if( lstat( name, &statbuf ) == 0 && S_ISSOCK( statbuf.st_mode ) )
+      unlink( name );
+
+   if( -1 == ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0 ) ) ||
+       -1 == bind( fd, (struct sockaddr *) &addr, sizeof(addr) ) || -1 == listen( fd, 64 ) )
+   {
+      fprintf(stderr,"edu: Cannot listen on %s: %s\n", name, strerror( errno ) );
+      exit(1);
+   }
+   return( fd );
+}
+
+/*
+        Scan the tree, then answer questions about it until told to stop.
+*/
+
+void ServeDirectory( char *dirname, Scan *scan, char *socketname, int Refresh )
+{
+   Watch w;
+   NameList out = { NULL, 0, 0 };
+   WatchNode **list = NULL;
+   size_t listsize = 0;
+   struct pollfd pfd[2];
+   struct timespec now;
+   struct sigaction sa;
+   double at, batch, refresh;
+   int lfd, busy = FALSE, wait;
+
+   WatchInit( &w, dirname, scan );
+   lfd = ServeListen( socketname );
+
+   memset( &sa, 0, sizeof(sa) );
+   sa.sa_handler = ServeSignal;
+   sigaction( SIGINT, &sa, NULL );
+   sigaction( SIGTERM, &sa, NULL );
+
+   fprintf(stderr,"edu: Serving %s on %s.\n", dirname, socketname );
+
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   at      = now.tv_sec + now.tv_nsec / 1e9;
+   batch   = at + SERVE_BATCH;
+   refresh = at + Refresh;
+
+   while( !ServeStop )
+   {
+      clock_gettime( CLOCK_MONOTONIC, &now );
+      at = now.tv_sec + now.tv_nsec / 1e9;
+
+      if( !busy && at >= batch )
+      {
+         if( Refresh > 0 && at >= refresh )
+         {
+            MarkTreeDirty( &w );
+            refresh = at + Refresh;
+         }
+         busy  = ( w.ndirty > 0 );
+         batch = at + SERVE_BATCH;
+      }
+
+      wait = busy ? 0 : (int)( ( batch - at ) * 1000 ) + 1;
+
+      pfd[0].fd     = w.ifd;
+      pfd[0].events = POLLIN;
+      pfd[1].fd     = lfd;
+      pfd[1].events = POLLIN;
+      if( poll( pfd, 2, wait ) > 0 )
+      {
+         if( pfd[1].revents & POLLIN )
+            ServeClient( &w, lfd, &out, &list, &listsize );
+         if( pfd[0].revents & POLLIN )
+            WatchEvents( &w );
+      }
+
+      if( busy )
+         busy = WatchRescan( &w, SERVE_SLICE );
+   }
+
+   close( lfd );
+   unlink( socketname );
+   free( out.buf );
+   free( list );
+   exit(0);
+}
+
+/*
+        Ask a server one question and print the answer the usual way.
+*/
+
+void ServeQuery( char *socketname, char *question, Scan *scan )
+{
+   struct sockaddr_un addr;
+   NameList in = { NULL, 0, 0 };
+   Total t;
+   char *line, *end, *path;
+   ssize_t n;
+   int fd;
+
+   memset( &addr, 0, sizeof(addr) );
+   addr.sun_family = AF_UNIX;
+   strncpy( addr.sun_path, socketname, sizeof(addr.sun_path) - 1 );
+
+   if( -1 == ( fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 ) ) ||
+       -1 == connect( fd, (struct sockaddr *) &addr, sizeof(addr) ) )
+   {
+      fprintf(stderr,"edu: Cannot connect to %s: %s\n", socketname, strerror( errno ) );
+      exit(1);
+   }
+
+   if( write( fd, question, strlen( question ) ) != (ssize_t) strlen( question ) )
+   {
+      fprintf(stderr,"edu: Cannot write to %s: %s\n", socketname, strerror( errno ) );
+      exit(1);
+   }
+   shutdown( fd, SHUT_WR );
+
+   for(;;)
+   {
+      Reserve( &in.buf, &in.size, in.len + 4096 );
+      if( 0 >= ( n = read( fd, in.buf + in.len, in.size - in.len ) ) )
+         break;
+      in.len += (size_t) n;
+   }
+   close( fd );
+
+   for( line = in.buf; line < in.buf + in.len; line = end + 1 )
+   {
+      if( NULL == ( end = memchr( line, '\n', (size_t)( in.buf + in.len - line ) ) ) )
+         break;
+      *end = 0;
+
+      if( 0 == strncmp( line, "error: ", 7 ) )
+      {
+         fprintf(stderr,"edu: %s\n", line + 7 );
+         exit(1);
+      }
+
+      t.Bytes = t.Allocated = strtoull( line, &path, 10 );
+      t.Files = 0;
+      PrintTotal( &t, scan->Sizes == SIZE_BOTH ? SIZE_APPARENT : scan->Sizes, scan->Units,
+                  scan->total_only ? NULL : path + 1 );
+   }
+   free( in.buf );
+}
+
+#endif /* __linux__ */
+
+/*
+  Return TRUE if a character is an option character, FALSE otherwise.
+*/
+
+int isOptionChar( char c )
+{
+   if( c == '/' || c == '-' )
+   {
+      return TRUE;
+   }
+   else
+   {
+      return FALSE;
+   }
+}
+
+
+/*
+  Return TRUE if an argument is the long option `name', with or without an
+  `=value' part, FALSE otherwise.  Case is ignored.  Long options are tested
+  before the single letter ones, so /threads is not taken for /total_only.
+*/
+
+int isOption( char *arg, char *name )
+{
+   if( !isOptionChar( arg[0] ) )
+   {
+      return FALSE;
+   }
+
+   for( arg++; *name != 0 && toupper( *arg ) == toupper( *name ); arg++, name++ )
+      ;
+
+   return ( *name == 0 && ( *arg == 0 || *arg == '=' ) );
+}
+
+
+#ifdef UNIX
+
+/*
+        Options that cannot be used together.  Each option seen is noted in
+        Given[] as it was typed, and CheckOptions() looks the pairs below up
+        before anything is read.  A pair is fatal when the option passed
+        over would change what is counted or printed, so a run never quietly
+        answers a different question than the one asked; when it would only
+        change how fast, it is ignored with a warning.
+*/
+
+#define OPT_THREADS           0
+#define OPT_DEVICE_THREADS    1
+#define OPT_CACHE             2
+#define OPT_DEDUPE            3
+#define OPT_XDEV              4
+#define OPT_EXCLUDE           5
+#define OPT_INCLUDE           6
+#define OPT_SORT_SIZE         7
+#define OPT_SORT_NAME         8
+#define OPT_TOP               9
+#define OPT_FORMAT           10         /* =ndjson or =csv             */
+#define OPT_FORMAT_BIN       11
+#define OPT_DIFF             12
+#define OPT_HISTOGRAM        13
+#define OPT_BY_OWNER         14
+#define OPT_DUPLICATES       15
+#define OPT_ESTIMATE         16
+#define OPT_SHARD            17
+#define OPT_MERGE            18
+#define OPT_WATCH            19
+#define OPT_SERVE            20
+#define OPT_TOTAL_ONLY       21
+#define OPT_LEVEL            22
+#define OPT_COUNT            23
+
+#define OPT( o )              ( 1UL << OPT_##o )
+
+typedef struct conflict{
+                          unsigned long  mode;      /* any of these        */
+                          unsigned long  with;      /* with any of these   */
+                          int            fatal;
+                     } Conflict;
+
+static Conflict Conflicts[] =
+{
+   { OPT( SERVE ),    OPT( THREADS ) | OPT( DEVICE_THREADS ) | OPT( CACHE ), FALSE },
+   { OPT( SERVE ),    OPT( WATCH ) | OPT( DEDUPE ) | OPT( XDEV ) | OPT( SORT_SIZE ) | OPT( SORT_NAME ) |
+                      OPT( TOP ) | OPT( FORMAT ) | OPT( FORMAT_BIN ) | OPT( DIFF ) | OPT( HISTOGRAM ) |
+                      OPT( BY_OWNER ) | OPT( DUPLICATES ) | OPT( ESTIMATE ) | OPT( SHARD ) | OPT( MERGE ), TRUE },
+   { OPT( WATCH ),    OPT( DEVICE_THREADS ), FALSE },
+   { OPT( WATCH ),    OPT( DEDUPE ) | OPT( XDEV ) | OPT( SORT_SIZE ) | OPT( SORT_NAME ) | OPT( TOP ) |
+                      OPT( FORMAT ) | OPT( FORMAT_BIN ) | OPT( DIFF ) | OPT( HISTOGRAM ) | OPT( BY_OWNER ) |
+                      OPT( DUPLICATES ) | OPT( ESTIMATE ) | OPT( SHARD ) | OPT( MERGE ), TRUE },
+   { OPT( MERGE ),    OPT( THREADS ) | OPT( DEVICE_THREADS ) | OPT( CACHE ), FALSE },
+   { OPT( MERGE ),    OPT( SHARD ) | OPT( ESTIMATE ) | OPT( DEDUPE ) | OPT( DUPLICATES ) | OPT( HISTOGRAM ) |
+                      OPT( BY_OWNER ), TRUE },
+   { OPT( ESTIMATE ), OPT( THREADS ) | OPT( DEVICE_THREADS ) | OPT( CACHE ), FALSE },
+   { OPT( ESTIMATE ), OPT( DEDUPE ) | OPT( SHARD ) | OPT( SORT_SIZE ) | OPT( SORT_NAME ) | OPT( TOP ) |
+                      OPT( FORMAT ) | OPT( FORMAT_BIN ) | OPT( DIFF ) | OPT( HISTOGRAM ) | OPT( BY_OWNER ) |
+                      OPT( DUPLICATES ), TRUE },
+   /* A shard is always written whole, as /sort=name /format=bin. */
+   { OPT( SHARD ),    OPT( FORMAT ) | OPT( SORT_SIZE ) | OPT( TOP ) | OPT( DIFF ) | OPT( TOTAL_ONLY ) |
+                      OPT( LEVEL ) | OPT( HISTOGRAM ) | OPT( BY_OWNER ) | OPT( DUPLICATES ), TRUE },
+   /* An index record does not say which links it counted, which names
+      were left out of it, or the file names, sizes, times and owners
+      behind its totals. */
+   { OPT( CACHE ),    OPT( DEDUPE ) | OPT( EXCLUDE ) | OPT( INCLUDE ) | OPT( HISTOGRAM ) | OPT( BY_OWNER ) |
+                      OPT( DUPLICATES ), TRUE },
+   /* Changes, histograms, owners and copies are listed as text. */
+   { OPT( DIFF ),     OPT( FORMAT ) | OPT( FORMAT_BIN ), TRUE },
+   { OPT( FORMAT ) | OPT( FORMAT_BIN ) | OPT( DIFF ),
+                      OPT( HISTOGRAM ) | OPT( BY_OWNER ) | OPT( DUPLICATES ), TRUE },
+   /* A binary file is a snapshot for /diff only in name order, whole. */
+   { OPT( FORMAT_BIN ), OPT( SORT_SIZE ) | OPT( TOP ), TRUE },
+};
+
+/*
+        Report every pair in Conflicts[] that was given, and exit if any of
+        them is fatal.  A warning is only printed once per option, for the
+        first mode that passes it over.
+*/
+
+void CheckOptions( char *given[ OPT_COUNT ] )
+{
+   unsigned long seen = 0, warned = 0;
+   size_t c;
+   int mode, with, fatal = FALSE;
+
+   for( mode = 0; mode < OPT_COUNT; mode++ )
+      if( given[mode] != NULL )
+         seen |= 1UL << mode;
+
+   for( c = 0; c < sizeof(Conflicts) / sizeof(Conflicts[0]); c++ )
+   {
+      if( ( seen & Conflicts[c].mode ) == 0 )
+         continue;
+      for( mode = 0; ( Conflicts[c].mode & seen & ( 1UL << mode ) ) == 0; mode++ )
+         ;
+      for( with = 0; with < OPT_COUNT; with++ )
+      {
+         if( ( Conflicts[c].with & seen & ( 1UL << with ) ) == 0 )
+            continue;
+         if( Conflicts[c].fatal )
+         {
+            fprintf(stderr,"edu: %s cannot be used with %s.\n", given[with], given[mode] );
+            fatal = TRUE;
+         }
+         else if( ( warned & ( 1UL << with ) ) == 0 )
+         {
+            fprintf(stderr,"edu: %s is ignored with %s.\n", given[with], given[mode] );
+            warned |= 1UL << with;
+         }
+      }
+   }
+
+   if( fatal )
+      exit(1);
+}
+
+#endif /* UNIX */
+
+
+int main( int argc, char *argv[] )
+{
+   char *path = ".";
+   Total OverallTotal;
+   Scan scan;
+#ifdef UNIX
+   Reader counters;
+   Cache cache;
+   char *CacheFile = NULL;
+   LinkSet links;
+   int DedupeLinks = FALSE;
+   Results results;
+   Top top;
+   Matcher exclude, include;
+   char *Given[ OPT_COUNT ];
+   Diff diff;
+   char *DiffName = NULL;
+   long TopCount = 0;
+   double EstimateError = 0.0;
+   NameList Inputs = { NULL, 0, 0 };
+   int Merging = FALSE;
+   Merge merge;
+   unsigned long long started = 0, start;
+#endif
+#ifdef __linux__
+   int WatchInterval = 0;
+   int Refresh = 0;
+   char *ServeSocket = NULL, *QuerySocket = NULL;
+#endif
+
+   memset( &scan, 0, sizeof(scan) );
+#ifdef UNIX
+   memset( &exclude, 0, sizeof(exclude) );
+   memset( &include, 0, sizeof(include) );
+   memset( Given, 0, sizeof(Given) );
+#endif
+
+#ifdef UNIX
+      scan.PathDelimiter  =  '/';
+#else
+      scan.PathDelimiter  = '\\';
+#endif
+
+   scan.RecursionLimit = 999;   /* Displays information for . (1) and the immediate subdirs ./a (2) */
+
+   scan.total_only = FALSE;
+
+   scan.Threads = 0;            /* 0 = the single threaded engine */
+
+   scan.ShowStats = FALSE;
+
+   scan.Sizes = SIZE_APPARENT;
+
+   scan.Units = UNIT_M;
+
+   scan.ShardDepth = 2;
+
+   while( --argc )
+   {
+#ifdef UNIX
+          /* Before /h, which takes anything starting with h. */
+
+      if( isOption( argv[argc], "histogram" ) )
+      {
+         scan.Histogram = TRUE;
+         Given[ OPT_HISTOGRAM ] = argv[argc];
+      }
+      else
+#endif
+      if( isOptionChar(argv[argc][0])  &&  toupper( argv[argc][1] ) == 'H' )
+      {
+         puts( "\nExtended Disk Usage 1.2  1993-96 Kenneth DeGrant\n\n"
+               "edu [/total_only]         ; Displays the overall total only\n"
+               "    [/help]               ; Displays this help message\n"
+               "    [/threads[=N]]        ; Scan with N threads (default: 1 per CPU)\n"
+               "    [/stats]              ; Report scan counters on stderr\n"
+               "    [/cache=FILE]         ; Reuse unchanged directories from FILE\n"
+               "    [/watch[=SECONDS]]    ; Keep watching, print changes (default: 10)\n"
+               "    [/serve=SOCKET]       ; Keep the tree, answer /query on SOCKET\n"
+               "    [/refresh=SECONDS]    ; With /serve, reread it all every SECONDS\n"
+               "    [/query=SOCKET]       ; Ask a /serve: total, /sort=size or /top=N\n"
+               "    [/dedupe-links]       ; Count hard linked files once\n"
+               "    [/allocated]          ; Space allocated on disk, not file sizes\n"
+               "    [/both]               ; File sizes, then allocated space\n"
+               "    [/xdev]               ; Stay on dirname's device\n"
+               "    [/device-threads=N]   ; At most N threads per device\n"
+               "    [/inode-order]        ; Stat and descend in inode order\n"
+               "    [/uring[=N]]          ; Up to N stats in flight (Linux)\n"
+               "    [/exclude=GLOB]       ; Leave out matching names (repeatable)\n"
+               "    [/include=GLOB]       ; Count only matching files (repeatable)\n"
+               "    [/sort=size|name]     ; List largest first, or by name\n"
+               "    [/top=N]              ; List only the N largest\n"
+               "    [/format=ndjson|csv|bin] ; Exact counts, machine readable\n"
+               "    [/diff=SNAPSHOT]      ; Print growth since a /format=bin snapshot\n"
+               "    [/histogram]          ; Sizes and ages of the files, by bucket\n"
+               "    [/by-owner[=group][,dirs]] ; Usage by user, or by group instead;\n"
+               "                          ; with dirs, under each directory too\n"
+               "    [/duplicates]         ; Then list identical files, most wasted first\n"
+               "    [/estimate[=PERCENT]] ; Sample for a total within PERCENT (default: 5)\n"
+               "    [/shard=K/N]          ; Scan shard K of N, as a file for /merge\n"
+               "    [/shard-depth=D]      ; Level whose directories are dealt out (default: 2)\n"
+               "    [/merge]              ; Put shard files together: edu /merge FILE...\n"
+               "    [/units=B|K|M|G|T|auto] ; Unit sizes are printed in (default: M)\n"
+               "    [/level=1..999]       ; Level to display directories:\n"
+               "                          ;   .     = 1\n"
+               "                          ;   ./a   = 2\n"
+               "                          ;   ./a/a = 3\n"
+               "                          ; Default = 999 or all\n"
+               "    [dirname]                                 \n");
+         exit(0);
+      }
+#ifdef UNIX
+      else if( isOption( argv[argc], "threads" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          if( p == NULL )
+          {
+             scan.Threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+             if( scan.Threads <= 0 )
+                scan.Threads = 1;
+          }
+          else
+          {
+             scan.Threads = atoi( p + 1 );
+          }
+
+          if( scan.Threads <= 0 || scan.Threads > 1024 )
+          {
+             fprintf(stderr,"edu: Invalid thread count of %d.\n", scan.Threads );
+             exit(1);
+          }
+          Given[ OPT_THREADS ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "stats" ) )
+      {
+         scan.ShowStats = TRUE;
+      }
+      else if( isOption( argv[argc], "cache" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          if( p == NULL || p[1] == 0 )
+          {
+             fprintf(stderr,"edu: /cache needs a file name.\n" );
+             exit(1);
+          }
+          CacheFile = p + 1;
+          Given[ OPT_CACHE ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "dedupe-links" ) )
+      {
+         DedupeLinks = TRUE;
+         Given[ OPT_DEDUPE ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "allocated" ) )
+      {
+         scan.Sizes = SIZE_ALLOCATED;
+      }
+      else if( isOption( argv[argc], "both" ) )
+      {
+         scan.Sizes = SIZE_BOTH;
+      }
+      else if( isOption( argv[argc], "exclude" ) || isOption( argv[argc], "include" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          int isexclude = ( toupper( argv[argc][1] ) == 'E' );
+
+          if( p == NULL || p[1] == 0 )
+          {
+             fprintf(stderr,"edu: /%s needs a pattern.\n", isexclude ? "exclude" : "include" );
+             exit(1);
+          }
+          if( isexclude )
+          {
+             MatcherAdd( &exclude, p + 1 );
+             scan.exclude = &exclude;
+             Given[ OPT_EXCLUDE ] = argv[argc];
+          }
+          else
+          {
+             MatcherAdd( &include, p + 1 );
+             scan.include = &include;
+             Given[ OPT_INCLUDE ] = argv[argc];
+          }
+      }
+      else if( isOption( argv[argc], "by-owner" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          size_t l;
+
+          scan.ByOwner = OWNER_UID;
+          for( p = ( p == NULL ) ? "" : p + 1; *p != 0; p += l + ( p[l] == ',' ) )
+          {
+             l = strcspn( p, "," );
+             if( l == 4 && 0 == strncmp( p, "user", 4 ) )
+                scan.ByOwner = OWNER_UID;
+             else if( l == 5 && 0 == strncmp( p, "group", 5 ) )
+                scan.ByOwner = OWNER_GID;
+             else if( l == 4 && 0 == strncmp( p, "dirs", 4 ) )
+                scan.OwnerDirs = TRUE;
+             else
+             {
+                fprintf(stderr,"edu: /by-owner takes user, group and dirs.\n" );
+                exit(1);
+             }
+          }
+          Given[ OPT_BY_OWNER ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "duplicates" ) )
+      {
+         scan.Duplicates = TRUE;
+         Given[ OPT_DUPLICATES ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "estimate" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          EstimateError = ( p == NULL ) ? 5.0 : atof( p + 1 );
+          if( EstimateError <= 0.0 || EstimateError >= 100.0 )
+          {
+             fprintf(stderr,"edu: Invalid /estimate error of %s.\n", p == NULL ? "" : p + 1 );
+             exit(1);
+          }
+          Given[ OPT_ESTIMATE ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "shard" ) )
+      {
+          char *p = strchr( argv[argc], '=' ), *end = NULL;
+
+          if( p != NULL )
+          {
+             scan.Shard  = (int) strtol( p + 1, &end, 10 );
+             scan.Shards = ( *end == '/' ) ? (int) strtol( end + 1, &end, 10 ) : 0;
+          }
+          if( p == NULL || *end != 0 || scan.Shards < 1 || scan.Shards > 4095 ||
+              scan.Shard < 1 || scan.Shard > scan.Shards )
+          {
+             fprintf(stderr,"edu: /shard needs =K/N, with 1 <= K <= N <= 4095.\n" );
+             exit(1);
+          }
+          scan.Shard--;
+          Given[ OPT_SHARD ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "shard-depth" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          scan.ShardDepth = ( p == NULL ) ? 0 : atoi( p + 1 );
+          if( scan.ShardDepth < 2 || scan.ShardDepth > 255 )
+          {
+             fprintf(stderr,"edu: Invalid /shard-depth of %d.\n", scan.ShardDepth );
+             exit(1);
+          }
+      }
+      else if( isOption( argv[argc], "merge" ) )
+      {
+         Merging = TRUE;
+         Given[ OPT_MERGE ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "inode-order" ) )
+      {
+         scan.InodeOrder = TRUE;
+      }
+      else if( isOption( argv[argc], "xdev" ) )
+      {
+         scan.OneFilesystem = TRUE;
+         Given[ OPT_XDEV ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "device-threads" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          scan.DeviceThreads = ( p == NULL ) ? 0 : atoi( p + 1 );
+          if( scan.DeviceThreads <= 0 || scan.DeviceThreads > 1024 )
+          {
+             fprintf(stderr,"edu: Invalid thread count of %d.\n", scan.DeviceThreads );
+             exit(1);
+          }
+          Given[ OPT_DEVICE_THREADS ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "sort" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          if( p != NULL && 0 == strcmp( p + 1, "size" ) )
+             scan.Sort = SORT_SIZE;
+          else if( p != NULL && 0 == strcmp( p + 1, "name" ) )
+             scan.Sort = SORT_NAME;
+          else
+          {
+             fprintf(stderr,"edu: /sort needs =size or =name.\n" );
+             exit(1);
+          }
+          Given[ scan.Sort == SORT_SIZE ? OPT_SORT_SIZE : OPT_SORT_NAME ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "format" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          if( p != NULL && 0 == strcmp( p + 1, "ndjson" ) )
+             scan.Format = FORMAT_NDJSON;
+          else if( p != NULL && 0 == strcmp( p + 1, "csv" ) )
+             scan.Format = FORMAT_CSV;
+          else if( p != NULL && 0 == strcmp( p + 1, "bin" ) )
+             scan.Format = FORMAT_BIN;
+          else
+          {
+             fprintf(stderr,"edu: /format needs =ndjson, =csv or =bin.\n" );
+             exit(1);
+          }
+          Given[ scan.Format == FORMAT_BIN ? OPT_FORMAT_BIN : OPT_FORMAT ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "diff" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          if( p == NULL || p[1] == 0 )
+          {
+             fprintf(stderr,"edu: /diff needs a snapshot file name.\n" );
+             exit(1);
+          }
+          DiffName = p + 1;
+          Given[ OPT_DIFF ] = argv[argc];
+      }
+      else if( isOption( argv[argc], "top" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          TopCount = ( p == NULL ) ? 0 : atol( p + 1 );
+          if( TopCount <= 0 )
+          {
+             fprintf(stderr,"edu: Invalid /top count.\n" );
+             exit(1);
+          }
+          Given[ OPT_TOP ] = argv[argc];
+      }
+#endif
+#ifdef __linux__
+      else if( isOption( argv[argc], "uring" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          scan.UringDepth = ( p == NULL ) ? URING_DEPTH : atoi( p + 1 );
+          if( scan.UringDepth <= 0 || scan.UringDepth > 4096 )
+          {
+             fprintf(stderr,"edu: Invalid /uring depth of %d.\n", scan.UringDepth );
+             exit(1);
+          }
+      }
+      else if( isOption( argv[argc], "serve" ) || isOption( argv[argc], "query" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          if( p == NULL || p[1] == 0 )
+          {
+             fprintf(stderr,"edu: /%s needs a socket name.\n", toupper( argv[argc][1] ) == 'S' ? "serve" : "query" );
+             exit(1);
+          }
+          if( toupper( argv[argc][1] ) == 'S' )
+          {
+             ServeSocket = p + 1;
+             Given[ OPT_SERVE ] = argv[argc];
+          }
+          else
+             QuerySocket = p + 1;
+      }
+      else if( isOption( argv[argc], "refresh" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          Refresh = ( p == NULL ) ? 0 : atoi( p + 1 );
+          if( Refresh <= 0 )
+          {
+             fprintf(stderr,"edu: Invalid refresh interval of %d.\n", Refresh );
+             exit(1);
+          }
+      }
+      else if( isOption( argv[argc], "watch" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+
+          WatchInterval = ( p == NULL ) ? 10 : atoi( p + 1 );
+          if( WatchInterval <= 0 )
+          {
+             fprintf(stderr,"edu: Invalid watch interval of %d.\n", WatchInterval );
+             exit(1);
+          }
+          Given[ OPT_WATCH ] = argv[argc];
+      }
+#endif
+      else if( isOption( argv[argc], "units" ) )
+      {
+          char *p = strchr( argv[argc], '=' );
+          char *units = "BKMGT";
+
+          if( p != NULL && 0 == strcmp( p + 1, "auto" ) )
+             scan.Units = UNIT_AUTO;
+          else if( p != NULL && p[1] != 0 && p[2] == 0 && strchr( units, toupper( p[1] ) ) != NULL )
+             scan.Units = (int)( strchr( units, toupper( p[1] ) ) - units );
+          else
+          {
+             fprintf(stderr,"edu: /units needs =B, =K, =M, =G, =T or =auto.\n" );
+             exit(1);
+          }
+      }
+      else if( isOptionChar(argv[argc][0]) && toupper( argv[argc][1] ) == 'T' )
+      {
+         scan.total_only = TRUE;
+#ifdef UNIX
+         Given[ OPT_TOTAL_ONLY ] = argv[argc];
+#endif
+      }
+      else if( isOptionChar(argv[argc][0]) && toupper( argv[argc][1] ) == 'L' )
+      {
+          char *p = strchr( argv[argc], '=' );
+          if( p == NULL )
+          {
+             scan.RecursionLimit = 999;
+          }
+          else
+          {
+             scan.RecursionLimit = atoi( p + 1);
+          }
+
+          if( scan.RecursionLimit <= 0 || scan.RecursionLimit > 999 )
+          {
+             fprintf(stderr,"edu: Invalid directory display limit of %d.\n", scan.RecursionLimit );
+             exit(1);
+          }
+#ifdef UNIX
+          if( scan.RecursionLimit < 999 )
+             Given[ OPT_LEVEL ] = argv[argc];
+#endif
+      }
+      else
+      {
+         path = argv[argc];
+#ifdef UNIX
+         NameAdd( &Inputs, path );
+#endif
+      }
+
+   }
+
+
+#ifdef UNIX
+   CheckOptions( Given );
+
+   if( scan.exclude != NULL )
+      MatcherCompile( scan.exclude );
+   if( scan.include != NULL )
+      MatcherCompile( scan.include );
+
+   if( scan.DeviceThreads > 0 && scan.Threads == 0 )
+   {
+      scan.Threads = (int) sysconf( _SC_NPROCESSORS_ONLN );
+      if( scan.Threads <= 0 )
+         scan.Threads = 1;
+   }
+
+   if( scan.OneFilesystem || scan.DeviceThreads > 0 )
+   {
+      struct stat statbuf;
+
+      if( stat( path, &statbuf ) == -1 )
+      {
+         fprintf(stderr,"Unable to open directory: %s\n", path );
+         perror("opendir:");
+         exit(1);
+      }
+      scan.Device = (unsigned long long) statbuf.st_dev;
+   }
+#endif
+
+#ifdef __linux__
+
+          /* /query only asks: the total of dirname, or the whole served
+             tree without one, its children with /sort=size, or the
+             largest below it with /top=N. */
+
+   if( QuerySocket != NULL )
+   {
+      char *question;
+      char *name = ( Inputs.len > 0 ) ? path : "";
+
+      if( NULL == ( question = malloc( strlen( name ) + 32 ) ) )
+      {
+         fprintf(stderr,"edu: Out of memory.\n");
+         exit(1);
+      }
+      if( TopCount > 0 )
+         sprintf( question, "top %ld %s\n", TopCount, name );
+      else if( scan.Sort == SORT_SIZE )
+         sprintf( question, "children %s\n", name );
+      else
+         sprintf( question, "total %s\n", name );
+
+      ServeQuery( QuerySocket, question, &scan );
+      free( question );
+      MatcherFree( &exclude );
+      MatcherFree( &include );
+      return 0;
+   }
+
+   if( ServeSocket != NULL )
+   {
+      if( scan.Sizes == SIZE_BOTH )
+         scan.Sizes = SIZE_APPARENT;
+      ServeDirectory( path, &scan, ServeSocket, Refresh );
+   }
+
+   if( WatchInterval > 0 )
+   {
+      if( scan.Sizes == SIZE_BOTH )
+         scan.Sizes = SIZE_APPARENT;
+      WatchDirectory( path, &scan, WatchInterval );
+   }
+#endif
+
+#ifdef UNIX
+   RaiseFileLimit();
+
+   memset( &counters, 0, sizeof(counters) );
+
+          /* /estimate samples on its own, serially, and prints one total.
+             /level, if given, is how many levels it counts in full. */
+
+   if( EstimateError > 0.0 )
+   {
+      if( scan.ShowStats )
+         started = Now();
+      OverallTotal = EstimateTotal( path, &scan, &counters, EstimateError / 100.0,
+                                    scan.RecursionLimit < 999 ? scan.RecursionLimit : 0 );
+      if( scan.ShowStats )
+         PrintStats( &scan, &counters, &OverallTotal, Now() - started );
+      free( Inputs.buf );
+      MatcherFree( &exclude );
+      MatcherFree( &include );
+      return 0;
+   }
+
+          /* A shard is written whole, as a snapshot in name order, for
+             /merge to put together with the others.  /merge reads the
+             shard files named on the command line in place of a tree. */
+
+   if( scan.Shards > 0 )
+   {
+      scan.Format = FORMAT_BIN;
+      scan.Sort   = SORT_NAME;
+   }
+   if( Merging )
+   {
+      CacheFile = NULL;
+      MergeInit( &merge, &Inputs, scan.total_only ? 1 : scan.RecursionLimit, scan.PathDelimiter );
+      path = merge.root;
+   }
+   free( Inputs.buf );
+
+   if( DedupeLinks )
+   {
+      LinkSetInit( &links );
+      scan.links = &links;
+   }
+
+          /* Histograms and owners are text, listed with each directory
+             when the directories are printed as they are finished, and
+             otherwise for the whole tree at the end.  Owners are listed
+             for the whole tree alone unless /by-owner=dirs asks for each
+             directory's. */
+
+   if( scan.Histogram || scan.ByOwner )
+   {
+      if( scan.total_only || scan.Sort != SORT_NONE || TopCount > 0 || ( !scan.Histogram && !scan.OwnerDirs ) )
+         scan.Details = DETAIL_TREE;
+      else
+         scan.Details = DETAIL_DIRS;
+      scan.Now = (long long) time( NULL );
+   }
+
+   if( CacheFile != NULL )
+   {
+      CacheOpen( &cache, CacheFile );
+      scan.cache = &cache;
+   }
+
+          /* /diff lists the scan by name to merge it with the snapshot,
+             and /top then counts changes.  A snapshot as dirname is
+             compared as it is, without scanning anything. */
+
+   if( DiffName != NULL )
+   {
+      struct stat statbuf;
+
+      DiffInit( &diff, DiffName, scan.total_only ? 1 : scan.RecursionLimit, scan.PathDelimiter );
+      scan.diff = &diff;
+      scan.Sort = SORT_NAME;
+
+      if( !Merging && stat( path, &statbuf ) == 0 && S_ISREG( statbuf.st_mode ) )
+      {
+         DiffFile( &diff, path, scan.PathDelimiter );
+         DiffList( &diff, &scan, (size_t) TopCount );
+         MatcherFree( &exclude );
+         MatcherFree( &include );
+         return 0;
+      }
+   }
+
+   FormatBegin( &scan );
+
+   if( scan.ShowStats )
+      started = Now();
+
+   if( TopCount > 0 && scan.diff == NULL )
+   {
+      memset( &top, 0, sizeof(top) );
+      top.max  = (size_t) TopCount;
+      scan.top = &top;
+   }
+   else if( scan.Sort != SORT_NONE )
+   {
+      ResultInit( &results, path );
+      scan.results = &results;
+   }
+
+   if( Merging )
+      OverallTotal = MergeTotal( &merge, &scan );
+   else if( scan.Threads > 0 )
+      OverallTotal = ParallelDirectoryTotal( path, &scan, &counters );
+   else
+   {
+      PathBuf pathbuf;
+
+      PathInit( &pathbuf, path );
+      OverallTotal = DirectoryTotal( path, &pathbuf, &counters, &scan );
+      free( pathbuf.buf );
+      free( counters.buf );
+      free( counters.window );
+      free( counters.names );
+#ifdef HAVE_URING
+      UringClose( counters.ring );
+#endif
+   }
+
+   start = StartCall( &scan );
+   if( scan.top != NULL )
+      TopList( scan.top, &scan );
+   else if( scan.results != NULL )
+   {
+      ResultList( scan.results, &scan );
+      ResultFree( scan.results );
+   }
+   if( scan.top != NULL || scan.results != NULL )
+      EndCall( &scan, &counters, CALL_OUTPUT, start );
+
+   if( scan.cache != NULL )
+      CacheClose( scan.cache );
+   if( scan.links != NULL )
+      LinkSetFree( scan.links );
+
+   if( scan.total_only && ( scan.Format != FORMAT_TEXT || scan.diff != NULL ) )
+      PrintLine( &scan, &OverallTotal, path, 1 );
+   else if( scan.total_only )
+      PrintTotal( &OverallTotal, scan.Sizes, scan.Units, NULL );
+
+   if( scan.Details == DETAIL_TREE )
+      PrintDetail( &scan, &counters.tree, TRUE );
+   ClearDetail( &counters.tree );
+
+   if( scan.diff != NULL )
+      DiffList( scan.diff, &scan, (size_t) TopCount );
+   if( Merging )
+      free( merge.root );
+
+   OutFlush();
+#else
+   OverallTotal =   DirectoryTotal( path, scan.total_only, scan.PathDelimiter, 1, scan.RecursionLimit, scan.Units ) ;
+
+   if( scan.total_only )
+      PrintTotal( &OverallTotal, scan.Sizes, scan.Units, NULL );
+#endif
+
+#ifdef UNIX
+   if( scan.ShowStats )
+      PrintStats( &scan, &counters, &OverallTotal, Now() - started );
+
+          /* After the scan's own numbers, which do not count it. */
+
+   if( scan.Duplicates )
+      FindDuplicates( &scan, &counters );
+
+   MatcherFree( &exclude );
+   MatcherFree( &include );
+#endif
+
+   return 0;
+}
 
 
@@ -0,0 +1,551 @@
+//----------------------------------------------------------------------------------------------------
+// libedu.hpp - Extended Disk Usage scanning library - header only, C++11
+//----------------------------------------------------------------------------------------------------
+//
+//    The EDU.cpp totalling engine on its own, with no main(), no printf and no exit(), so that it can
+//    be built into other programs.  EDU.cpp is a thin client of it.
+//
+//    libedu.hpp holds the EDU.cpp engine; edu.c does not use it.  edu.c has engines of its own, and
+//    its threads, getdents64 reads, /cache index, /watch and the rest are not here.  A change to how
+//    either program counts has to be made in both, and bench/samecount.sh checks that the two still
+//    print the same byte totals for the same tree.
+//
+//    A scan walks a directory tree depth first, keeping one small Frame per open directory on a heap
+//    stack and one path that grows and shrinks with the walk, and tells a visitor what it finds:
+//
+//        on_enter_dir( path, level )           before a directory's entries; the start is level 1
+//        on_file( entry )                      each file counted, with its sizes
+//        on_leave_dir( path, level, total )    after them, with the directory's total, everything
+//                                              below it included
+//        on_error( path )                      a directory could not be opened and is left out
+//
+//    The visitor is a template parameter, not a virtual interface.  Derive it from edu::Visitor to
+//    get empty versions of the calls it does not want, and those calls compile away.
+//
+//    How to scan is chosen at compile time by three policies:
+//
+//        Output    edu::EveryDirectory   on_enter_dir and on_leave_dir for every directory
+//                  edu::TotalOnly        neither, only the total of the whole tree comes back
+//
+//        Sizes     edu::ApparentSize     file lengths only
+//                  edu::AllocatedSize    the space on disk as well (st_blocks, or
+//                                        GetCompressedFileSize on Windows)
+//
+//        Links     edu::CountLinks       every name of a file counts
+//                  edu::DedupeLinks      a file with several hard links counts once, under the
+//                                        first name found (POSIX; on Windows every name counts)
+//
+//    so a total only scan of file lengths compiles down to a read-and-add loop with no per directory
+//    calls and no on-disk size lookups in it at all.
+//
+//    Example:
+//
+//        struct Printer : edu::Visitor
+//        {
+//            void on_leave_dir( const char *szPath, int iLevel, const edu::Total &sTotal )
+//            {
+//                printf( "%llu %s\n", (unsigned long long) sTotal.bytes, szPath );
+//            }
+//        };
+//
+//        Printer    sPrinter;
+//        edu::Total sTotal = edu::Walk< edu::EveryDirectory, edu::ApparentSize, edu::CountLinks >( ".", sPrinter );
+//
+//    Windows is read with FindFirstFile.  Everything else is read with openat, readdir and fstatat,
+//    each directory opened relative to its parent and never through a symbolic link.
+//
+//----------------------------------------------------------------------------------------------------
+//
+#ifndef LIBEDU_HPP
+#define LIBEDU_HPP
+
+#include<stdint.h>
+#include<string.h>
+#include<string>
+#include<vector>
+#include<unordered_set>
+
+#ifdef _WIN32
+#include<windows.h>
+#else
+#include<sys/types.h>
+#include<sys/stat.h>
+#include<dirent.h>
+#include<fcntl.h>
+#include<unistd.h>
+#endif
+
+namespace edu
+{
+
+#ifdef _WIN32
+const char PathDelimiter = '\\';
+#else
+const char PathDelimiter = '/';
+#endif
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Total - A directory total as exact 64 bit byte and file counts.  allocated stays 0 unless the
+///           scan's Sizes policy asks for it.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct Total
+{
+    uint64_t bytes;
+    uint64_t allocated;
+    uint64_t files;
+};
+
+inline void AddTotal( const Total &sFrom, Total &sTo )
+{
+    sTo.bytes     += sFrom.bytes;
+    sTo.allocated += sFrom.allocated;
+    sTo.files     += sFrom.files;
+
+}//AddTotal
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Entry - One file as handed to on_file.  dev, ino and nlink are 0 on Windows.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct Entry
+{
+    const char *name;       // within its directory, valid for the call only
+    int         level;      // of the directory it is in
+    uint64_t    size;
+    uint64_t    allocated;  // 0 unless asked for
+    uint64_t    dev;
+    uint64_t    ino;
+    uint64_t    nlink;
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Visitor - Empty versions of every call, to derive visitors from.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct Visitor
+{
+    void on_enter_dir( const char *, int ) {}
+    void on_file( const Entry & ) {}
+    void on_leave_dir( const char *, int, const Total & ) {}
+    void on_error( const char * ) {}
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Output policies - Whether the visitor hears about each directory.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct EveryDirectory
+{
+    template< class V > static void Enter( V &sVisitor, const char *szPath, int iLevel )
+    {
+        sVisitor.on_enter_dir( szPath, iLevel );
+    }
+
+    template< class V > static void Leave( V &sVisitor, const char *szPath, int iLevel, const Total &sTotal )
+    {
+        sVisitor.on_leave_dir( szPath, iLevel, sTotal );
+    }
+};
+
+struct TotalOnly
+{
+    template< class V > static void Enter( V &, const char *, int ) {}
+    template< class V > static void Leave( V &, const char *, int, const Total & ) {}
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Sizes policies - Whether the space on disk is looked up as well as the length.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct ApparentSize
+{
+    static const bool allocated = false;
+};
+
+struct AllocatedSize
+{
+    static const bool allocated = true;
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Links policies - first() says whether a file is counted.  DedupeLinks remembers the device and
+///                    inode of every file with more than one link; files with one never need it.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+struct CountLinks
+{
+    bool first( const Entry & ) { return true; }
+};
+
+class DedupeLinks
+{
+public:
+    bool first( const Entry &sEntry )
+    {
+        Key sKey = { sEntry.dev, sEntry.ino };
+
+        return sEntry.nlink < 2 || m_sSeen.insert( sKey ).second;
+    }
+
+private:
+    struct Key
+    {
+        uint64_t dev;
+        uint64_t ino;
+
+        bool operator==( const Key &sOther ) const { return dev == sOther.dev && ino == sOther.ino; }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()( const Key &sKey ) const
+        {
+            return (size_t)( ( sKey.ino * 0x9E3779B97F4A7C15ULL ) ^ sKey.dev );
+        }
+    };
+
+    std::unordered_set< Key, KeyHash > m_sSeen;
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Walker - The totalling engine, put together from the three policies.  A Walker may be used for
+///            more than one scan; with DedupeLinks a file counted in one is not counted again.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+template< class Output, class Sizes, class Links >
+class Walker
+{
+public:
+
+#ifdef _WIN32
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Walk - Total the tree at szDirectoryName.  Each directory's first entry comes with
+    ///          FindFirstFile and the rest with FindNextFile, so the one find data is shared.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > Total Walk( const char *szDirectoryName, V &sVisitor )
+    {
+        std::vector< Frame > sStack;
+        std::string          sPath( szDirectoryName );
+        WIN32_FIND_DATA      sFileInfo;
+        Total                sDirTotal = { 0, 0, 0 };
+        DWORD                dwHigh    = 0;
+        DWORD                dwLow     = 0;
+        bool                 bMore     = true;
+
+        Push( sStack, sPath, sPath.size(), sFileInfo, sVisitor );
+
+        while( !sStack.empty() )
+        {
+            Frame *pFrame = &sStack.back();
+
+            if( pFrame->bStarted )
+            {
+                bMore = ( FindNextFile( pFrame->hFind, &sFileInfo ) != 0 );
+            }
+            else
+            {
+                bMore = true;
+                pFrame->bStarted = true;
+            }
+
+            if( !bMore )
+            {
+                FindClose( pFrame->hFind );
+                Pop( sStack, sPath, sDirTotal, sVisitor );
+                continue;
+            }
+
+            if( ( sFileInfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) == FILE_ATTRIBUTE_DIRECTORY )
+            {
+                if( !IsDotDir( sFileInfo.cFileName ) )
+                {
+                    size_t cbPathLength = sPath.size();
+
+                    sPath += PathDelimiter;
+                    sPath += sFileInfo.cFileName;
+
+                    if( !Push( sStack, sPath, cbPathLength, sFileInfo, sVisitor ) )
+                    {
+                        sPath.resize( cbPathLength );
+                    }
+                }
+                continue;
+            }
+
+            Entry sEntry = { sFileInfo.cFileName, (int) sStack.size(), 0, 0, 0, 0, 0 };
+
+            sEntry.size = ( (uint64_t) sFileInfo.nFileSizeHigh << 32 ) + sFileInfo.nFileSizeLow;
+
+            //
+            // The on-disk size needs the file's full path.  If it can't be had, the apparent size
+            // stands in for it.
+            //
+            if( Sizes::allocated )
+            {
+                size_t cbPathLength = sPath.size();
+
+                sPath += PathDelimiter;
+                sPath += sFileInfo.cFileName;
+                dwLow  = GetCompressedFileSize( sPath.c_str(), &dwHigh );
+                sPath.resize( cbPathLength );
+
+                sEntry.allocated = ( dwLow != INVALID_FILE_SIZE || GetLastError() == NO_ERROR )
+                                 ? ( (uint64_t) dwHigh << 32 ) + dwLow : sEntry.size;
+            }
+
+            Count( *pFrame, sEntry, sVisitor );
+        }
+
+        return sDirTotal;
+
+    }//Walk
+
+#else
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Walk - Total the tree at szDirectoryName.  Entries the directory says are subdirectories or
+    ///          symbolic links are never stat'ed; the rest are stat'ed relative to their directory.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > Total Walk( const char *szDirectoryName, V &sVisitor )
+    {
+        std::vector< Frame > sStack;
+        std::string          sPath( szDirectoryName );
+        Total                sDirTotal = { 0, 0, 0 };
+        struct dirent       *pEntry;
+        struct stat          sStat;
+
+        Push( sStack, AT_FDCWD, szDirectoryName, sPath, sPath.size(), sVisitor );
+
+        while( !sStack.empty() )
+        {
+            Frame *pFrame = &sStack.back();
+            int    fd     = dirfd( pFrame->pDir );
+            int    iType;
+
+            if( NULL == ( pEntry = readdir( pFrame->pDir ) ) )
+            {
+                closedir( pFrame->pDir );
+                Pop( sStack, sPath, sDirTotal, sVisitor );
+                continue;
+            }
+
+            if( IsDotDir( pEntry->d_name ) )
+            {
+                continue;
+            }
+
+#ifdef _DIRENT_HAVE_D_TYPE
+            iType = pEntry->d_type;
+#else
+            iType = DT_UNKNOWN;
+#endif
+            if( iType == DT_LNK )
+            {
+                continue;
+            }
+
+            if( iType != DT_DIR )
+            {
+                if( fstatat( fd, pEntry->d_name, &sStat, AT_SYMLINK_NOFOLLOW ) == -1 || S_ISLNK( sStat.st_mode ) )
+                {
+                    continue;
+                }
+                iType = S_ISDIR( sStat.st_mode ) ? DT_DIR : DT_REG;
+            }
+
+            if( iType == DT_DIR )
+            {
+                size_t cbPathLength = sPath.size();
+
+                sPath += PathDelimiter;
+                sPath += pEntry->d_name;
+
+                if( !Push( sStack, fd, pEntry->d_name, sPath, cbPathLength, sVisitor ) )
+                {
+                    sPath.resize( cbPathLength );
+                }
+                continue;
+            }
+
+            Entry sEntry = { pEntry->d_name, (int) sStack.size(), (uint64_t) sStat.st_size,
+                             Sizes::allocated ? (uint64_t) sStat.st_blocks * 512 : 0,
+                             (uint64_t) sStat.st_dev, (uint64_t) sStat.st_ino, (uint64_t) sStat.st_nlink };
+
+            Count( *pFrame, sEntry, sVisitor );
+        }
+
+        return sDirTotal;
+
+    }//Walk
+
+#endif
+
+private:
+
+#ifdef _WIN32
+    struct Frame
+    {
+        HANDLE  hFind;
+        Total   sTotal;
+        size_t  cbPathLength;   // of the parent's path
+        bool    bStarted;
+    };
+#else
+    struct Frame
+    {
+        DIR    *pDir;
+        Total   sTotal;
+        size_t  cbPathLength;   // of the parent's path
+    };
+#endif
+
+    Links m_sLinks;
+
+    static bool IsDotDir( const char *szName )
+    {
+        return szName[ 0 ] == '.' && ( szName[ 1 ] == 0 || ( szName[ 1 ] == '.' && szName[ 2 ] == 0 ) );
+    }
+
+#ifdef _WIN32
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Push - Start the search of the directory at sPath and put it on top of the stack.  On return
+    ///          sFileInfo holds the directory's first entry.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > static bool Push( std::vector< Frame > &sStack, std::string &sPath, size_t cbPathLength,
+                                          WIN32_FIND_DATA &sFileInfo, V &sVisitor )
+    {
+        size_t cbPathNow = sPath.size();
+        HANDLE hFind;
+
+        sPath += "\\*.*";
+        hFind  = FindFirstFile( sPath.c_str(), &sFileInfo );
+        sPath.resize( cbPathNow );
+
+        if( hFind == INVALID_HANDLE_VALUE )
+        {
+            sVisitor.on_error( sPath.c_str() );
+            return false;
+        }
+
+        Frame sFrame = { hFind, { 0, 0, 0 }, cbPathLength, false };
+
+        sStack.push_back( sFrame );
+        Output::Enter( sVisitor, sPath.c_str(), (int) sStack.size() );
+        return true;
+
+    }//Push
+
+#else
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Push - Open directory szName below fdParent and put it on top of the stack.  The starting
+    ///          directory may be a symbolic link, the ones below it may not.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > static bool Push( std::vector< Frame > &sStack, int fdParent, const char *szName,
+                                          std::string &sPath, size_t cbPathLength, V &sVisitor )
+    {
+        int  fd   = openat( fdParent, szName, O_RDONLY | O_DIRECTORY | O_CLOEXEC | ( sStack.empty() ? 0 : O_NOFOLLOW ) );
+        DIR *pDir = ( fd == -1 ) ? NULL : fdopendir( fd );
+
+        if( pDir == NULL )
+        {
+            if( fd != -1 )
+            {
+                close( fd );
+            }
+            sVisitor.on_error( sPath.c_str() );
+            return false;
+        }
+
+        Frame sFrame = { pDir, { 0, 0, 0 }, cbPathLength };
+
+        sStack.push_back( sFrame );
+        Output::Enter( sVisitor, sPath.c_str(), (int) sStack.size() );
+        return true;
+
+    }//Push
+
+#endif
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Pop - The directory on top is done and closed: report it and add it into its parent, or keep
+    ///         it as the tree's total if it was the start.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > static void Pop( std::vector< Frame > &sStack, std::string &sPath, Total &sDirTotal, V &sVisitor )
+    {
+        Frame sFrame = sStack.back();
+
+        Output::Leave( sVisitor, sPath.c_str(), (int) sStack.size(), sFrame.sTotal );
+
+        sPath.resize( sFrame.cbPathLength );
+        sStack.pop_back();
+
+        if( sStack.empty() )
+        {
+            sDirTotal = sFrame.sTotal;
+        }
+        else
+        {
+            AddTotal( sFrame.sTotal, sStack.back().sTotal );
+        }
+
+    }//Pop
+
+    ///------------------------------------------------------------------------------------------------
+    ///<summary>
+    ///   Count - Add a file into its directory's total, unless the Links policy has counted it already.
+    ///</summary>
+    ///------------------------------------------------------------------------------------------------
+    template< class V > void Count( Frame &sFrame, const Entry &sEntry, V &sVisitor )
+    {
+        if( !m_sLinks.first( sEntry ) )
+        {
+            return;
+        }
+
+        sFrame.sTotal.bytes     += sEntry.size;
+        sFrame.sTotal.allocated += sEntry.allocated;
+        sFrame.sTotal.files++;
+
+        sVisitor.on_file( sEntry );
+
+    }//Count
+};
+
+///----------------------------------------------------------------------------------------------------
+///<summary>
+///   Walk - Total the tree at szDirectoryName with a Walker of its own.
+///</summary>
+///----------------------------------------------------------------------------------------------------
+template< class Output, class Sizes, class Links, class V >
+Total Walk( const char *szDirectoryName, V &sVisitor )
+{
+    Walker< Output, Sizes, Links > sWalker;
+
+    return sWalker.Walk( szDirectoryName, sVisitor );
+
+}//Walk
+
+}//namespace edu
+
+#endif